@@ -0,0 +1,248 @@
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Streaming decompression of compressed input files.
+ */
+
+#include "compressed_input.h"
+
+#include <cstdio>
+#include <iostream>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "tokenizer.h"  // find_char
+
+Compression detect_compression(const std::string& name) {
+  FILE* f = fopen(name.c_str(), "rb");
+  if (f == NULL) return NO_COMPRESSION;
+  unsigned char magic[4] = { 0, 0, 0, 0 };
+  size_t read = fread(magic, 1, sizeof(magic), f);
+  fclose(f);
+  if (read >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    return GZIP;
+  }
+  if (read >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+                   magic[2] == 0x2f && magic[3] == 0xfd) {
+    return ZSTD;
+  }
+  return NO_COMPRESSION;
+}
+
+CompressedLineSource::CompressedLineSource(size_t block_size,
+                                           size_t num_blocks)
+    : blocks(num_blocks < 2 ? 2 : num_blocks), producer_index(0),
+      consumer_index(0), filled(0), reading(false), stopped(false),
+      finished(false), curr(NULL), last(NULL) {
+  for (size_t i = 0; i < blocks.size(); i++) {
+    blocks[i].data.resize(block_size);
+    blocks[i].size = 0;
+    blocks[i].last = false;
+  }
+}
+
+CompressedLineSource::~CompressedLineSource() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+  cond.notify_all();
+  if (producer.joinable()) {
+    producer.join();
+  }
+}
+
+bool CompressedLineSource::open(const std::string& name,
+                                Compression compression) {
+  switch (compression) {
+    case GZIP:
+      producer = std::thread(&CompressedLineSource::decompress_gzip,
+                             this, name);
+      return true;
+#ifdef HAVE_ZSTD
+    case ZSTD:
+      producer = std::thread(&CompressedLineSource::decompress_zstd,
+                             this, name);
+      return true;
+#endif
+    default:
+      std::cerr << "Compression format of " << name << " is not supported."
+                << std::endl;
+      return false;
+  }
+}
+
+CompressedLineSource::Block* CompressedLineSource::wait_for_free_block() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!stopped && filled == blocks.size()) {
+    cond.wait(lock);
+  }
+  return stopped ? NULL : &blocks[producer_index];
+}
+
+void CompressedLineSource::block_filled() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    producer_index = (producer_index + 1) % blocks.size();
+    filled++;
+  }
+  cond.notify_all();
+}
+
+void CompressedLineSource::decompress_gzip(std::string name) {
+  gzFile gz = gzopen(name.c_str(), "rb");
+  if (gz == NULL) {
+    perror("gzopen failed");
+  } else {
+    gzbuffer(gz, 1 << 17);
+  }
+  while (true) {
+    Block* block = wait_for_free_block();
+    if (block == NULL) break;
+    int read = gz != NULL ? gzread(gz, &block->data[0],
+                                   static_cast<unsigned>(block->data.size()))
+                          : 0;
+    if (read < 0) {
+      int errnum;
+      std::cerr << "Error decompressing " << name << ": "
+                << gzerror(gz, &errnum) << std::endl;
+      read = 0;
+    }
+    block->size = static_cast<size_t>(read);
+    /* gzread() only returns less than requested at the end of the file. */
+    block->last = block->size < block->data.size();
+    block_filled();
+    if (block->last) break;
+  }
+  if (gz != NULL) {
+    gzclose(gz);
+  }
+}
+
+#ifdef HAVE_ZSTD
+void CompressedLineSource::decompress_zstd(std::string name) {
+  FILE* f = fopen(name.c_str(), "rb");
+  if (f == NULL) {
+    perror("fopen failed");
+  }
+  ZSTD_DStream* stream = ZSTD_createDStream();
+  ZSTD_initDStream(stream);
+  std::vector<char> in_buffer(ZSTD_DStreamInSize());
+  ZSTD_inBuffer input = { &in_buffer[0], 0, 0 };
+  bool eof = f == NULL;
+
+  while (true) {
+    Block* block = wait_for_free_block();
+    if (block == NULL) break;
+    ZSTD_outBuffer output = { &block->data[0], block->data.size(), 0 };
+    while (output.pos < output.size) {
+      if (input.pos == input.size) {
+        if (eof) break;
+        input.size = fread(&in_buffer[0], 1, in_buffer.size(), f);
+        input.pos = 0;
+        if (input.size == 0) {
+          eof = true;
+          break;
+        }
+      }
+      size_t ret = ZSTD_decompressStream(stream, &output, &input);
+      if (ZSTD_isError(ret)) {
+        std::cerr << "Error decompressing " << name << ": "
+                  << ZSTD_getErrorName(ret) << std::endl;
+        eof = true;
+        break;
+      }
+    }
+    block->size = output.pos;
+    block->last = eof;
+    block_filled();
+    if (block->last) break;
+  }
+  ZSTD_freeDStream(stream);
+  if (f != NULL) {
+    fclose(f);
+  }
+}
+#endif
+
+bool CompressedLineSource::next_block() {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (reading) {
+    if (blocks[consumer_index].last) {
+      finished = true;
+    }
+    reading = false;
+    consumer_index = (consumer_index + 1) % blocks.size();
+    filled--;
+    cond.notify_all();
+  }
+  if (finished) {
+    return false;
+  }
+  while (!stopped && filled == 0) {
+    cond.wait(lock);
+  }
+  if (filled == 0) {
+    return false;
+  }
+  reading = true;
+  curr = &blocks[consumer_index].data[0];
+  last = curr + blocks[consumer_index].size;
+  return true;
+}
+
+bool CompressedLineSource::next_line(const char*& line_begin,
+                                     const char*& line_end) {
+  /* Empty lines are skipped, as in LineTokenizer. */
+  while (true) {
+    if (curr >= last) {
+      if (!next_block()) return false;
+      continue;
+    }
+    const char* nl = find_char(curr, last, '\n');
+    if (nl < last || blocks[consumer_index].last) {
+      line_begin = curr;
+      line_end = nl;
+      curr = nl < last ? nl + 1 : last;
+    } else {
+      /* The line continues in the next block(s). */
+      carry.assign(curr, last);
+      curr = last;
+      bool complete = false;
+      while (!complete && next_block()) {
+        nl = find_char(curr, last, '\n');
+        carry.append(curr, nl);
+        curr = nl < last ? nl + 1 : last;
+        complete = nl < last || blocks[consumer_index].last;
+      }
+      line_begin = carry.data();
+      line_end = line_begin + carry.size();
+    }
+    if (line_end > line_begin && *(line_end - 1) == '\r') {
+      line_end--;
+    }
+    if (line_end > line_begin) {
+      return true;
+    }
+  }
+}
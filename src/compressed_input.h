@@ -0,0 +1,136 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Streaming decompression of compressed input files. gzip is always
+ * supported; zstd only if compiled with @c HAVE_ZSTD (and linked with
+ * @c -lzstd).
+ */
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** The compression formats recognized by CompressedLineSource. */
+enum Compression {
+  NO_COMPRESSION,
+  GZIP,
+  ZSTD
+};
+
+/**
+ * Returns the compression format of file @p name, based on the magic bytes at
+ * the beginning of the file.
+ */
+Compression detect_compression(const std::string& name);
+
+/**
+ * Decompresses a file on a background thread into a ring of buffers, and
+ * returns its lines the same way LineTokenizer does. Decompression thus
+ * overlaps with the parsing of the lines already decompressed.
+ */
+class CompressedLineSource {
+public:
+  /**
+   * @param[in] block_size the size of a buffer in the ring.
+   * @param[in] num_blocks the number of buffers in the ring.
+   */
+  CompressedLineSource(size_t block_size=4 << 20, size_t num_blocks=4);
+  /** Stops the background thread. */
+  ~CompressedLineSource();
+
+  /**
+   * Opens file @p name, and starts decompressing it.
+   * @return @c false if the file could not be opened or the format is not
+   *                  supported.
+   */
+  bool open(const std::string& name, Compression compression);
+
+  /**
+   * Returns the next (non-empty) line in <tt>[line_begin, line_end)</tt>. The
+   * pointers are valid until the next call.
+   * @return @c false at the end of the file.
+   */
+  bool next_line(const char*& line_begin, const char*& line_end);
+
+private:
+  /* No copying. */
+  CompressedLineSource(const CompressedLineSource&);
+  CompressedLineSource& operator=(const CompressedLineSource&);
+
+  /** A buffer in the ring. */
+  struct Block {
+    std::vector<char> data;
+    /** The number of valid bytes in @c data. */
+    size_t size;
+    /** Whether this is the last block of the file. */
+    bool last;
+  };
+
+  /** The body of the background thread: decompresses gzip files. */
+  void decompress_gzip(std::string name);
+#ifdef HAVE_ZSTD
+  /** The body of the background thread: decompresses zstd files. */
+  void decompress_zstd(std::string name);
+#endif
+
+  /**
+   * Producer side: waits for a free block.
+   * @return the block, or @c NULL if the reader has been stopped.
+   */
+  Block* wait_for_free_block();
+  /** Producer side: hands the block returned by wait_for_free_block() over. */
+  void block_filled();
+
+  /**
+   * Consumer side: releases the current block (if any) and waits for the next
+   * one.
+   * @return @c false if there are no more blocks.
+   */
+  bool next_block();
+
+  /** The ring. */
+  std::vector<Block> blocks;
+  /** The index of the next block the producer fills. */
+  size_t producer_index;
+  /** The index of the block the consumer reads. */
+  size_t consumer_index;
+  /** The number of filled blocks, including the one being read. */
+  size_t filled;
+  /** Whether the consumer is reading a block. */
+  bool reading;
+  /** Set by the destructor to stop the producer. */
+  bool stopped;
+  /** Set when the consumer has read the last block. */
+  bool finished;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::thread producer;
+
+  /** The current position in and the end of the current block. */
+  const char* curr;
+  const char* last;
+  /** Lines that span block boundaries are assembled here. */
+  std::string carry;
+};
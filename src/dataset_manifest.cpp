@@ -0,0 +1,138 @@
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * The sidecar manifest written next to the shards of a dataset.
+ */
+
+#include "dataset_manifest.h"
+
+#include <cstring>
+#include <fstream>
+
+#include <sys/stat.h>
+
+#include "tokenizer.h"  // MmapFile
+
+DatasetManifest::DatasetManifest()
+  : version(SHARD_FORMAT_VERSION), file_size(0), mtime(0), hash(0),
+    dimensions(0), nshards(0) {}
+
+bool DatasetManifest::fingerprint(const std::string& file_name,
+                                  const std::string& options_) {
+  struct stat st;
+  if (stat(file_name.c_str(), &st) != 0) {
+    return false;
+  }
+  version   = SHARD_FORMAT_VERSION;
+  file_size = static_cast<uint64_t>(st.st_size);
+  mtime     = static_cast<int64_t>(st.st_mtime);
+  hash      = hash_file(file_name);
+  options   = options_;
+  return true;
+}
+
+bool DatasetManifest::same_input(const DatasetManifest& other) const {
+  return version == other.version && file_size == other.file_size &&
+         mtime == other.mtime && hash == other.hash &&
+         options == other.options;
+}
+
+std::string DatasetManifest::manifest_name(const std::string& file_name) {
+  return file_name + ".ltrmanifest";
+}
+
+bool DatasetManifest::load(const std::string& file_name) {
+  std::ifstream in(manifest_name(file_name).c_str());
+  if (!in) {
+    return false;
+  }
+  std::string key;
+  bool has_version = false;
+  while (in >> key) {
+    if (key == "version") {
+      in >> version;
+      has_version = true;
+    } else if (key == "file_size") {
+      in >> file_size;
+    } else if (key == "mtime") {
+      in >> mtime;
+    } else if (key == "hash") {
+      in >> std::hex >> hash >> std::dec;
+    } else if (key == "options") {
+      in >> std::ws;
+      std::getline(in, options);
+    } else if (key == "dimensions") {
+      in >> dimensions;
+    } else if (key == "nshards") {
+      in >> nshards;
+    } else {
+      std::getline(in, key);  // Unknown key: skip the line
+    }
+  }
+  return has_version && !in.bad();
+}
+
+bool DatasetManifest::save(const std::string& file_name) const {
+  std::ofstream out(manifest_name(file_name).c_str());
+  out << "version "    << version << std::endl
+      << "file_size "  << file_size << std::endl
+      << "mtime "      << mtime << std::endl
+      << "hash "       << std::hex << hash << std::dec << std::endl
+      << "options "    << options << std::endl
+      << "dimensions " << dimensions << std::endl
+      << "nshards "    << nshards << std::endl;
+  return out.good();
+}
+
+namespace {
+/** The hash of the @p size bytes at @p p; see hash_file(). */
+uint64_t hash_bytes(const char* p, size_t size) {
+  const uint64_t prime = 0x100000001b3ULL;
+  uint64_t h = 0xcbf29ce484222325ULL ^ size;
+  const char* end = p + size;
+  /* FNV-1a on 64-bit words; the shift propagates the high bits downwards. */
+  for (; end - p >= 8; p += 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    h = (h ^ word) * prime;
+    h ^= h >> 29;
+  }
+  for (; p < end; p++) {
+    h = (h ^ static_cast<unsigned char>(*p)) * prime;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+}
+
+uint64_t hash_file(const std::string& file_name) {
+  MmapFile file;
+  if (!file.open(file_name)) {
+    return 0;
+  }
+  return hash_bytes(file.begin(), file.size());
+}
+
+uint64_t hash_string(const std::string& data) {
+  return hash_bytes(data.data(), data.size());
+}
@@ -0,0 +1,90 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * The sidecar manifest written next to the shards of a dataset. It records
+ * the fingerprint of the input file and the options it was sharded with, as
+ * well as the results of the sharding (the number of features and shards), so
+ * that later runs on the same file can skip parsing and sharding altogether.
+ */
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+
+/**
+ * The version of the shard format. Must be increased whenever the edge or
+ * vertex data layout changes, so that old shards are not reused.
+ */
+const int SHARD_FORMAT_VERSION = 4;
+
+/**
+ * The number of shards recorded for a dataset that was not sharded, as its
+ * input was grouped by query and written directly into the query block store;
+ * see read_inner().
+ */
+const int QUERY_BLOCKS_ONLY = -1;
+
+class DatasetManifest {
+public:
+  DatasetManifest();
+
+  /**
+   * Creates the fingerprint part of the manifest: the size, modification time
+   * and content hash of @p file_name.
+   * @param[in] options the reader and sharding options that affect the shards
+   *                    (e.g. the reader type, nshards, sparse...).
+   * @return @c false if the file cannot be read.
+   */
+  bool fingerprint(const std::string& file_name, const std::string& options);
+
+  /** Whether the fingerprints of the two manifests are the same. */
+  bool same_input(const DatasetManifest& other) const;
+
+  /** Loads the manifest of dataset @p file_name. */
+  bool load(const std::string& file_name);
+  /** Saves the manifest of dataset @p file_name. */
+  bool save(const std::string& file_name) const;
+
+  /** The name of the manifest file of dataset @p file_name. */
+  static std::string manifest_name(const std::string& file_name);
+
+  /* The fingerprint. */
+  int version;
+  uint64_t file_size;
+  int64_t mtime;
+  uint64_t hash;
+  std::string options;
+
+  /* The results. */
+  size_t dimensions;
+  /** The number of shards, or @c QUERY_BLOCKS_ONLY. */
+  int nshards;
+};
+
+/**
+ * A fast 64-bit hash of the contents of @p file_name. It processes the file
+ * in 64-bit words, so it is limited by I/O rather than by the hashing.
+ */
+uint64_t hash_file(const std::string& file_name);
+
+/** The hash_file() of a file whose contents are @p data. */
+uint64_t hash_string(const std::string& data);
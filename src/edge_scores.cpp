@@ -0,0 +1,74 @@
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * The scores of the query-document edges, kept outside of the shards.
+ */
+
+#include "edge_scores.h"
+
+#include <cstdio>  // perror
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+EdgeScores::EdgeScores() : data(NULL), length(0) {}
+
+EdgeScores::~EdgeScores() {
+  unmap();
+}
+
+void EdgeScores::unmap() {
+  if (data != NULL) {
+    munmap(data, length * sizeof(double));
+    data = NULL;
+  }
+  length = 0;
+}
+
+bool EdgeScores::resize(size_t size, const std::string& file_name) {
+  unmap();
+  if (size == 0) return true;
+
+  size_t bytes = size * sizeof(double);
+  void* addr;
+  if (file_name.empty()) {
+    addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  } else {
+    int fd = open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, bytes) != 0) {
+      perror("Cannot create the score file");
+      if (fd >= 0) close(fd);
+      return false;
+    }
+    addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    /* The mapping keeps the file open. */
+    close(fd);
+  }
+  if (addr == MAP_FAILED) {
+    perror("Cannot map the score array");
+    return false;
+  }
+  data   = static_cast<double*>(addr);
+  length = size;
+  return true;
+}
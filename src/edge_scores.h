@@ -0,0 +1,64 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * The scores of the query-document edges, kept outside of the shards.
+ */
+
+#include <cstddef>
+#include <string>
+
+/**
+ * A memory-mapped array of the scores the model gives to the query-document
+ * edges, indexed by the edge ordinal in EHeader. As the scores are not
+ * stored on the edges, scoring does not make the shards dirty, and they need
+ * not be written back after each iteration.
+ */
+class EdgeScores {
+public:
+  EdgeScores();
+  /** Unmaps the array. */
+  ~EdgeScores();
+
+  /**
+   * Maps a new, zeroed array of @p size scores; the old contents are lost.
+   * @param[in] file_name the backing file. If empty, the array is anonymous
+   *                      memory.
+   * @return @c false if the array could not be mapped.
+   */
+  bool resize(size_t size, const std::string& file_name="");
+
+  inline size_t size() const { return length; }
+  inline double& operator[](size_t ordinal) { return data[ordinal]; }
+  inline double operator[](size_t ordinal) const { return data[ordinal]; }
+
+private:
+  /* No copying. */
+  EdgeScores(const EdgeScores&);
+  EdgeScores& operator=(const EdgeScores&);
+
+  /** Unmaps the array. */
+  void unmap();
+
+  double* data;
+  /** The number of scores. */
+  size_t length;
+};
@@ -28,44 +28,49 @@
 #include <numeric>    // std::accumulate
 
 #include "ltr_common.hpp"
+#include "query_table.h"
 
 class EvaluationMeasure : public GraphChiProgram<TypeVertex, FeatureEdge> {
 public:
   EvaluationMeasure(int cutoff)
-    : cutoff(cutoff) {}
+    : cutoff(cutoff), scores(NULL), queries(NULL) {}
+
+  /** Sets the array the scores of the edges are read from. */
+  void set_scores(const EdgeScores* scores) {
+    this->scores = scores;
+  }
+
+  /**
+   * Sets the QueryTable of the current dataset. The table must outlive the
+   * run.
+   */
+  void set_query_table(const QueryTable* queries) {
+    this->queries = queries;
+  }
 
   /**
-   * Clears the eval object before each iteration. This might not be the fastest
-   * way to do this, but at this point I don't care.
+   * Allocates the eval vector before the first iteration, so that update()
+   * only writes the element of its query.
    */
   void before_iteration(int iteration, graphchi_context &ginfo) {
     if (iteration == 0) {
-      eval.clear();
+      eval.assign(queries->size(), 0);
     }
   }
 
   void update(graphchi_vertex<TypeVertex, FeatureEdge> &vertex,
               graphchi_context &gcontext) {
-    if (vertex.get_data().type == DOCUMENT) {
+    /* Documents have no out-edges. */
+    if (vertex.num_outedges() == 0) {
       return;
     }
 
-    if (gcontext.iteration == 0) {
-      // TODO: mutex!
-      eval[vertex.id()] = 0;
-    }
-    compute_measure(vertex, gcontext);
+    compute_measure(vertex, queries->find(vertex.id()), gcontext);
   }
 
   /** Aggregates the evaluations. */
   void after_iteration(int iteration, graphchi_context &ginfo) {
-    avg_eval = 0;
-    for (std::map<vid_t, double>::const_iterator it = eval.begin();
-         it != eval.end(); ++it) {
-      avg_eval += it->second;
-    }
-    avg_eval /= eval.size();
-//    avg_eval = std::accumulate(eval.begin(), eval.end(), 0.0) / eval.size();
+    avg_eval = std::accumulate(eval.begin(), eval.end(), 0.0) / eval.size();
   }
 
 protected:
@@ -74,20 +79,21 @@ protected:
    * must implement this. Since this the evaluators run after an iteration of
    * the learning algorithm, the scores on the edges should be valid.
    *
-   * When this method is called for the <tt>n</tt>'s query, <tt>eval</tt>'s size
-   * is guaranteed to be @c n. Implementations of this method should write the
-   * computed measure into the last element.
+   * Implementations of this method should write the computed measure into
+   * <tt>eval[query]</tt>.
+   *
+   * @param[in] query the index of @p v in the QueryTable.
    */
   virtual void compute_measure(graphchi_vertex<TypeVertex, FeatureEdge> &v,
-                               graphchi_context &gcontext)=0;
+                               size_t query, graphchi_context &gcontext)=0;
 
   /**
    * Creates a heap from the @c cutoff best edges from vertex @p v,
-   * according to comp.
+   * according to comp (rel_comp() or a ScoreComp).
    */
+  template <typename Comp>
   std::vector<FeatureEdge*> get_best(
-            graphchi_vertex<TypeVertex, FeatureEdge> &v,
-            bool (*comp)(const FeatureEdge*, const FeatureEdge*))
+            graphchi_vertex<TypeVertex, FeatureEdge> &v, Comp comp)
   {
     int heap_size = std::min(cutoff, v.num_edges());
     //DYN std::vector<FeatureEdge*> best(heap_size);
@@ -102,7 +108,7 @@ protected:
       for (int e = heap_size; e < v.num_edges(); e++) {
         //DYN FeatureEdge* vect = v.edge(e)->get_vector();
         FeatureEdge* vect = v.edge(e)->get_vector();
-        if (EvaluationMeasure::rel_comp(vect, best[best.size() - 1])) {
+        if (comp(vect, best[best.size() - 1])) {
           best[best.size() - 1] = vect;
           std::push_heap(best.begin(), best.end(), comp);
           std::pop_heap(best.begin(), best.end(), comp);
@@ -114,12 +120,6 @@ protected:
     return best;
   }
 
-  /** For inverse heap sorting by score. Needed by the implementations. */
-  static bool score_comp(const FeatureEdge* e1, const FeatureEdge* e2) {
-    //DYN return e1->get(e1->size() - 1) > e2->get(e2->size() - 1);
-    return e1->header().score > e2->header().score;
-  }
-
   /** For inverse heap sorting by relevance. Needed by the implementations. */
   static bool rel_comp(const FeatureEdge* e1, const FeatureEdge* e2) {
     //DYN return e1->get(e1->size() - 2) > e2->get(e2->size() - 2);
@@ -127,18 +127,18 @@ protected:
   }
 
 public:
-  /**
-   * The values of the evaluation measure for each query. Cannot be a vector
-   * because the order the vertices are traversed is not constant.
-   */
-//  std::vector<double> eval;
-  std::map<vid_t, double> eval;
+  /** The values of the evaluation measure for each query in the QueryTable. */
+  std::vector<double> eval;
   /** The average of the former; computed in after_iteration(). */
   double avg_eval;
 
 protected:
   /** The "at" in "nDCG@20". */
   int cutoff;
+  /** The scores of the edges; see set_scores(). */
+  const EdgeScores* scores;
+  /** The queries of the dataset; see set_query_table(). */
+  const QueryTable* queries;
 };
 
 /** The nDCG measure. */
@@ -147,11 +147,11 @@ public:
   NdcgEvaluator(int cutoff) : EvaluationMeasure(cutoff) {}
 
   /**
-   * Computes the DCG. If @p comp is @c score_comp, the method computes DCG; if
-   * @c rel_comp is used, it computes IDCG. 
+   * Computes the DCG. If @p comp is a ScoreComp, the method computes DCG; if
+   * @c rel_comp is used, it computes IDCG.
    */
-  double compute_dcg(graphchi_vertex<TypeVertex, FeatureEdge> &v,
-                     bool (*comp)(const FeatureEdge*, const FeatureEdge*)) {
+  template <typename Comp>
+  double compute_dcg(graphchi_vertex<TypeVertex, FeatureEdge> &v, Comp comp) {
     std::vector<FeatureEdge*> best = get_best(v, comp);
 //    std::cout << "RANKING for query " << v.get_data().id << ": ";
 
@@ -167,24 +167,29 @@ public:
     return dcg;
   }
 
+  /** Also reads the ideal DCGs from the QueryTable in the first iteration. */
+  void before_iteration(int iteration, graphchi_context &ginfo) {
+    EvaluationMeasure::before_iteration(iteration, ginfo);
+    if (iteration == 0) {
+      idcgs.resize(queries->size());
+      for (size_t q = 0; q < idcgs.size(); q++) {
+        idcgs[q] = queries->idcg(q, cutoff);
+      }
+    }
+  }
+
   void compute_measure(graphchi_vertex<TypeVertex, FeatureEdge> &v,
-                                 graphchi_context &gcontext) {
+                       size_t query, graphchi_context &gcontext) {
     /** Compute the DCG. */
-    if (gcontext.iteration == 0) {
-      // TODO: mutex!
-      idcgs[v.id()] = compute_dcg(v, EvaluationMeasure::rel_comp);
-//      std::cout << "IDCG[" << v.id() << "] = " << idcgs[v.id()] << std::endl;
-    }
-    double dcg = compute_dcg(v, EvaluationMeasure::score_comp);
-    eval[v.id()] = idcgs[v.id()] != 0 ? dcg / idcgs[v.id()] : 0;
-//    std::cout << "NDCG[" << v.get_data().id << "] = " << dcg << " / " << idcgs[v.id()]
-//              << " = " << eval[v.id()] << std::endl;
+    double dcg = compute_dcg(v, ScoreComp(scores));
+    eval[query] = idcgs[query] != 0 ? dcg / idcgs[query] : 0;
+//    std::cout << "NDCG[" << v.get_data().id << "] = " << dcg << " / " << idcgs[query]
+//              << " = " << eval[query] << std::endl;
   }
 
 private:
-  /** Stores the DCGs for the query nodes. Required to compute nDCG. */
-//  std::vector<double> idcgs;
-  std::map<vid_t, double> idcgs;
+  /** The ideal DCGs of the queries. Required to compute nDCG. */
+  std::vector<double> idcgs;
 };
 
 ///**
@@ -0,0 +1,105 @@
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * String interning for query and document ids.
+ */
+
+#include "id_interner.h"
+
+#include <cstring>
+
+const uint32_t IdInterner::NOT_FOUND;
+
+IdInterner::IdInterner(size_t expected) : offsets(1, 0) {
+  size_t slots = 16;
+  while (slots < 2 * expected) slots *= 2;
+  table.assign(2 * slots, NOT_FOUND);
+  mask = slots - 1;
+}
+
+uint32_t IdInterner::hash(const char* s, size_t length) {
+  /* FNV-1a. */
+  uint32_t h = 2166136261U;
+  for (size_t i = 0; i < length; i++) {
+    h = (h ^ static_cast<unsigned char>(s[i])) * 16777619U;
+  }
+  return h;
+}
+
+bool IdInterner::intern(const char* s, size_t length, uint32_t& index) {
+  uint32_t h = hash(s, length);
+  size_t slot = h & mask;
+  while (table[2 * slot + 1] != NOT_FOUND) {
+    uint32_t i = table[2 * slot + 1];
+    if (table[2 * slot] == h && offsets[i + 1] - offsets[i] == length &&
+        memcmp(chars.data() + offsets[i], s, length) == 0) {
+      index = i;
+      return false;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  index = static_cast<uint32_t>(size());
+  chars.insert(chars.end(), s, s + length);
+  offsets.push_back(chars.size());
+  table[2 * slot]     = h;
+  table[2 * slot + 1] = index;
+  /* Keep the load factor under 1/2. */
+  if (2 * size() > mask + 1) {
+    grow();
+  }
+  return true;
+}
+
+uint32_t IdInterner::find(const char* s, size_t length) const {
+  uint32_t h = hash(s, length);
+  size_t slot = h & mask;
+  while (table[2 * slot + 1] != NOT_FOUND) {
+    uint32_t i = table[2 * slot + 1];
+    if (table[2 * slot] == h && offsets[i + 1] - offsets[i] == length &&
+        memcmp(chars.data() + offsets[i], s, length) == 0) {
+      return i;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return NOT_FOUND;
+}
+
+void IdInterner::grow() {
+  std::vector<uint32_t> old_table;
+  old_table.swap(table);
+  table.assign(2 * old_table.size(), NOT_FOUND);
+  mask = (mask << 1) | 1;
+  for (size_t slot = 0; slot < old_table.size(); slot += 2) {
+    if (old_table[slot + 1] != NOT_FOUND) {
+      insert(old_table[slot], old_table[slot + 1]);
+    }
+  }
+}
+
+void IdInterner::insert(uint32_t h, uint32_t index) {
+  size_t slot = h & mask;
+  while (table[2 * slot + 1] != NOT_FOUND) {
+    slot = (slot + 1) & mask;
+  }
+  table[2 * slot]     = h;
+  table[2 * slot + 1] = index;
+}
@@ -0,0 +1,83 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * String interning for query and document ids.
+ */
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Assigns consecutive integer ids (0, 1, ...) to strings. The strings are
+ * stored in a single buffer, and looked up in an open-addressing hash table
+ * with linear probing, so interning does not allocate memory per string.
+ */
+class IdInterner {
+public:
+  /** Returned by find() for unknown strings. */
+  static const uint32_t NOT_FOUND = 0xffffffff;
+
+  /** @param[in] expected the expected number of strings. */
+  IdInterner(size_t expected=1024);
+
+  /**
+   * Interns <tt>[s, s + length)</tt>.
+   * @param[out] index the id of the string.
+   * @return @c true if the string has not been seen before.
+   */
+  bool intern(const char* s, size_t length, uint32_t& index);
+  inline bool intern(const std::string& s, uint32_t& index) {
+    return intern(s.data(), s.length(), index);
+  }
+
+  /** Returns the id of <tt>[s, s + length)</tt>, or @c NOT_FOUND. */
+  uint32_t find(const char* s, size_t length) const;
+  inline uint32_t find(const std::string& s) const {
+    return find(s.data(), s.length());
+  }
+
+  /** The number of strings interned. */
+  inline size_t size() const { return offsets.size() - 1; }
+  /** The string with id @p index. */
+  inline std::string str(uint32_t index) const {
+    return std::string(chars.data() + offsets[index],
+                       offsets[index + 1] - offsets[index]);
+  }
+
+private:
+  /** Doubles the size of the hash table. */
+  void grow();
+  /** Inserts string @p index with hash @p hash into the table. */
+  void insert(uint32_t hash, uint32_t index);
+
+  static uint32_t hash(const char* s, size_t length);
+
+  /** The strings, concatenated. */
+  std::vector<char> chars;
+  /** The start of each string in @c chars, plus the end of the last one. */
+  std::vector<uint64_t> offsets;
+  /** The hash table: (hash, index) pairs; empty slots are @c NOT_FOUND. */
+  std::vector<uint32_t> table;
+  /** The number of slots in the table - 1. */
+  size_t mask;
+};
@@ -0,0 +1,150 @@
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Filters applied to the data at ingestion.
+ */
+
+#include "ingest_filter.h"
+
+#include <algorithm>
+#include <fstream>
+
+FeatureMap::FeatureMap() : kept(0) {}
+
+bool FeatureMap::identity() const {
+  return kept == index.size();
+}
+
+void FeatureMap::reindex() {
+  kept = 0;
+  for (size_t i = 0; i < index.size(); i++) {
+    if (index[i] != DROPPED) {
+      index[i] = static_cast<int>(kept++);
+    }
+  }
+}
+
+void FeatureMap::apply(std::vector<feature_t>& row, bool sparse) const {
+  if (!sparse) {
+    buffer.assign(kept, 0);
+    size_t length = std::min(row.size(), index.size());
+    for (size_t i = 0; i < length; i++) {
+      if (index[i] != DROPPED) {
+        buffer[index[i]] = row[i];
+      }
+    }
+    row.swap(buffer);
+  } else {
+    size_t out = 0;
+    for (size_t i = 0; i + 1 < row.size(); i += 2) {
+      size_t feature = static_cast<size_t>(row[i]);
+      if (feature < index.size() && index[feature] != DROPPED) {
+        row[out++] = static_cast<feature_t>(index[feature]);
+        row[out++] = row[i + 1];
+      }
+    }
+    row.resize(out);
+  }
+}
+
+std::string FeatureMap::map_name(const std::string& file_name) {
+  return file_name + ".fmap";
+}
+
+bool FeatureMap::save(const std::string& file_name) const {
+  std::ofstream out(map_name(file_name).c_str());
+  out << "input_dimensions " << index.size() << std::endl << "dropped";
+  for (size_t i = 0; i < index.size(); i++) {
+    if (index[i] == DROPPED) {
+      out << " " << i;
+    }
+  }
+  out << std::endl;
+  return out.good();
+}
+
+bool FeatureMap::load(const std::string& file_name) {
+  std::ifstream in(map_name(file_name).c_str());
+  std::string key;
+  size_t input_dimensions;
+  if (!(in >> key) || key != "input_dimensions" ||
+      !(in >> input_dimensions) || !(in >> key) || key != "dropped") {
+    return false;
+  }
+  index.assign(input_dimensions, 0);
+  size_t feature;
+  while (in >> feature) {
+    if (feature >= input_dimensions) return false;
+    index[feature] = DROPPED;
+  }
+  reindex();
+  return in.eof();
+}
+
+IngestStats::IngestStats() : num_rows(0) {}
+
+void IngestStats::add_row(uint32_t query, int rel,
+                          const std::vector<feature_t>& row, bool sparse) {
+  num_rows++;
+  if (query >= relevance.size()) {
+    relevance.resize(query + 1, std::make_pair(rel, rel));
+  }
+  relevance[query].first  = std::min(relevance[query].first, rel);
+  relevance[query].second = std::max(relevance[query].second, rel);
+
+  size_t step = sparse ? 2 : 1;
+  for (size_t i = 0; i + step - 1 < row.size(); i += step) {
+    size_t feature  = sparse ? static_cast<size_t>(row[i]) : i;
+    feature_t value = sparse ? row[i + 1] : row[i];
+    if (feature >= present.size()) {
+      min_value.resize(feature + 1, value);
+      max_value.resize(feature + 1, value);
+      present.resize(feature + 1, 0);
+    }
+    if (present[feature]++ == 0) {
+      min_value[feature] = max_value[feature] = value;
+    } else if (value < min_value[feature]) {
+      min_value[feature] = value;
+    } else if (value > max_value[feature]) {
+      max_value[feature] = value;
+    }
+  }
+}
+
+bool IngestStats::constant_query(uint32_t query) const {
+  return query < relevance.size() &&
+         relevance[query].first == relevance[query].second;
+}
+
+FeatureMap IngestStats::constant_feature_map() const {
+  FeatureMap map;
+  map.index.assign(present.size(), 0);
+  for (size_t i = 0; i < present.size(); i++) {
+    bool constant = present[i] == 0 ||
+                    (min_value[i] == max_value[i] &&
+                     (present[i] == num_rows || min_value[i] == 0));
+    if (constant) {
+      map.index[i] = FeatureMap::DROPPED;
+    }
+  }
+  map.reindex();
+  return map;
+}
@@ -0,0 +1,129 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Filters applied to the data at ingestion: dropping the queries that yield no
+ * document pairs, and the features that are constant in the training set.
+ */
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+#include "ml/feature.h"
+
+/**
+ * Maps the feature indices of the input to those of the stored data, from
+ * which some features have been dropped.
+ */
+class FeatureMap {
+public:
+  /** Index of the dropped features. */
+  static const int DROPPED = -1;
+
+  /** The identity map. */
+  FeatureMap();
+
+  /** Whether the map drops no features. */
+  bool identity() const;
+  /** The number of features in the input. */
+  inline size_t input_dimensions() const { return index.size(); }
+  /** The number of features kept. */
+  inline size_t dimensions() const { return kept; }
+  /** The new index of input feature @p feature, or @c DROPPED. */
+  inline int operator[](size_t feature) const {
+    return feature < index.size() ? index[feature] : DROPPED;
+  }
+
+  /**
+   * Maps a row in place. Dense rows become dimensions() long; from sparse rows
+   * (@c index, @c value pairs), the dropped features are removed and the
+   * others renumbered. Features beyond input_dimensions() are dropped.
+   */
+  void apply(std::vector<feature_t>& row, bool sparse) const;
+
+  /** Saves the map of dataset @p file_name. */
+  bool save(const std::string& file_name) const;
+  /** Loads the map of dataset @p file_name. */
+  bool load(const std::string& file_name);
+
+  /** The name of the map file of dataset @p file_name. */
+  static std::string map_name(const std::string& file_name);
+
+  friend class IngestStats;
+
+private:
+  /** Renumbers the kept features. */
+  void reindex();
+
+  /** The new index of each input feature, or @c DROPPED. */
+  std::vector<int> index;
+  /** The number of features kept. */
+  size_t kept;
+  /** The values of the dense row being mapped. */
+  mutable std::vector<feature_t> buffer;
+};
+
+/**
+ * Statistics collected in a streaming pass over the input, before anything
+ * is written: the range of the relevance values of each query, and of each
+ * feature.
+ */
+class IngestStats {
+public:
+  IngestStats();
+
+  /**
+   * Adds a row of query @p query, which is the index of the query id in the
+   * order of first appearance.
+   */
+  void add_row(uint32_t query, int relevance,
+               const std::vector<feature_t>& row, bool sparse);
+
+  /** The number of rows added. */
+  inline size_t rows() const { return num_rows; }
+
+  /**
+   * Whether all documents of query @p query have the same relevance. Such
+   * queries yield no document pairs, and their IDCG is 0.
+   */
+  bool constant_query(uint32_t query) const;
+
+  /**
+   * Returns the map that drops the features with zero variance, i.e. those
+   * whose minimum and maximum are the same. Missing (sparse or trailing)
+   * values count as 0.
+   */
+  FeatureMap constant_feature_map() const;
+
+private:
+  size_t num_rows;
+  /** The minimum and maximum relevance of each query. */
+  std::vector<std::pair<int, int> > relevance;
+  /** The minimum and maximum value of each feature, where present. */
+  std::vector<feature_t> min_value;
+  std::vector<feature_t> max_value;
+  /** The number of rows in which a feature is present. */
+  std::vector<size_t> present;
+};
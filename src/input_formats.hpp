@@ -24,139 +24,508 @@
  */
 /* Use dynamic edge data (i.e. chivector). */
 
-#include <map>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <sys/stat.h>
 
 #include "ltr_common.hpp"
+#include "dataset_manifest.h"
+#include "id_interner.h"
+#include "ingest_filter.h"
+#include "static_features.h"
+#include "query_table.h"
 #include "input_readers.h"
+#include "query_block_engine.hpp"
 #include "graphchi_basic_includes.hpp"
 
 using namespace graphchi;
 
 /**
- * Reads the data from a csv file. The document and query ids can be strings;
- * all features are converted to doubles.
- *
- * @param file_name the name of the file.
- * @param[out] dimensions the number of features is written to this parameter.
- * @param qid_col the column of the query id. 0 by default.
- * @param doc_col the column of the document id. 1 by default.
- * @param rel_col the column with the relevance level; by default, the last one.
- * @param has_header if true, the first row is disregarded.
- * @return the number of shards.
- * @todo compute number of queries instead of expecting it as parameter.
+ * Updates the number of features after a row has been read. In sparse mode
+ * (the @c sparse option), @p features contains (index, value) pairs, and the
+ * number of features is one more than the largest index seen thus far.
  */
-int read_csv(const std::string& file_name, size_t& dimensions,
-             int qid_col=0, int doc_col=1, int rel_col=-1,
-             bool has_header=true) {
-  /* Create sharder object */
-  int nshards;
-  sharder<double, EHeader> sharderobj(file_name);
-  sharderobj.start_preprocessing();
-
-  CsvReader reader(file_name, qid_col, doc_col, rel_col, has_header);
-  std::string qid;
-  std::string doc;
-  int relevance;
-  std::vector<double> features;
-  while (reader.read_line(qid, doc, relevance, features)) {
-    // TODO: ids might be non-consecutive, use something to handle this
-    vid_t qid_i = (vid_t)strtoul(qid.c_str(), NULL, 10);
-    vid_t doc_i = (vid_t)strtoul(doc.c_str(), NULL, 10);
-    // DEBUG only
-    EHeader hdr(relevance, doc_i);
-    //sharderobj.preprocessing_add_edge(qid_i, doc_i, edge_data);
-    sharderobj.preprocessing_add_edge_multival(qid_i, doc_i, hdr, features);
-  }
-  /* Save the number of features. */
-  dimensions = features.size();
-
-  sharderobj.end_preprocessing();
-
-  logstream(LOG_INFO) << "Now creating shards." << std::endl;
+inline void update_dimensions(size_t& dimensions,
+                              const std::vector<feature_t>& features,
+                              bool sparse) {
+  if (!sparse) {
+    dimensions = features.size();
+  } else {
+    for (size_t i = 0; i < features.size(); i += 2) {
+      if (features[i] >= dimensions) {
+        dimensions = static_cast<size_t>(features[i]) + 1;
+      }
+    }
+  }
+}
 
-  /*
-   * Shard with a specified number of shards, or determine automatically if not
-   * defined
+/** The name of the file that lists the query vertices of @p file_name. */
+inline std::string query_vertices_name(const std::string& file_name) {
+  return file_name + ".qvids";
+}
+
+/**
+ * Saves the vertex ids of the queries, so that the engine can schedule only
+ * those; see LtrAlgorithm::schedule_queries().
+ */
+inline bool save_query_vertices(const std::string& file_name,
+                                const std::vector<vid_t>& queries) {
+  FILE* f = fopen(query_vertices_name(file_name).c_str(), "wb");
+  if (f == NULL) return false;
+  bool ok = fwrite(queries.data(), sizeof(vid_t), queries.size(), f) ==
+            queries.size();
+  return fclose(f) == 0 && ok;
+}
+
+/** Loads the list saved by save_query_vertices(). */
+inline bool load_query_vertices(const std::string& file_name,
+                                std::vector<vid_t>& queries) {
+  FILE* f = fopen(query_vertices_name(file_name).c_str(), "rb");
+  if (f == NULL) return false;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  queries.resize(size > 0 ? size / sizeof(vid_t) : 0);
+  bool ok = size >= 0 &&
+            fread(queries.data(), sizeof(vid_t), queries.size(), f) ==
+                queries.size();
+  fclose(f);
+  return ok;
+}
+
+/** The filters read_inner() applies to the data; see ingest_filter.h. */
+struct IngestOptions {
+  IngestOptions()
+    : drop_constant_queries(false), drop_constant_features(false) {}
+
+  /** Drop the queries whose documents all have the same relevance. */
+  bool drop_constant_queries;
+  /** Drop the features that are constant, and save the FeatureMap. */
+  bool drop_constant_features;
+  /**
+   * If not empty, the features are mapped with the FeatureMap of this dataset
+   * (i.e. that of the training set).
    */
-  nshards = sharderobj.execute_sharding(get_option_string("nshards", "auto"));
+  std::string feature_map_of;
+  /**
+   * The (input) indices of the document-static features, which are stored in
+   * a StaticFeatureTable instead of on the edges.
+   */
+  std::vector<size_t> static_features;
+};
 
-  return nshards;
+/**
+ * Replays the blocks of the query block store @p store_name into the sharder;
+ * used by read_inner() when the input turns out not to be grouped by query.
+ */
+inline bool replay_query_blocks(const std::string& store_name,
+                                sharder<feature_t, EHeader>& sharderobj) {
+  QueryBlockStore store;
+  if (!store.open(store_name)) {
+    return false;
+  }
+  QueryBlockPrefetcher prefetcher(store, 64 << 20);
+  if (!prefetcher.start()) {
+    return false;
+  }
+  size_t chunks = 0;
+  std::vector<feature_t> features;
+  while (QueryBlockChunk* chunk = prefetcher.next()) {
+    for (size_t i = chunk->first_block; i < chunk->last_block; i++) {
+      QueryBlockView block = chunk->block(store, i);
+      const feature_t* values = block.features;
+      for (uint32_t d = 0; d < block.num_docs; d++) {
+        const DocRecord& doc = block.docs[d];
+        features.assign(values, values + doc.length);
+        EHeader hdr(doc.relevance, doc.ordinal, doc.sparse != 0,
+                    doc.static_row);
+        sharderobj.preprocessing_add_edge_multival(block.query, doc.doc,
+                                                   hdr, features);
+        values += doc.length;
+      }
+    }
+    chunks++;
+  }
+  return chunks == prefetcher.num_chunks();
 }
 
 /**
  * Reads LETOR-like formats.
  *
- * @param[in] reader the reader object.
+ * The file is parsed by @c ingest_threads threads (1 by default) in chunks of
+ * @c ingest_chunk_mb megabytes, and consumed one query at a time; see
+ * QueryBlockReader. If the @c sparse option is set, only the non-zero
+ * features are stored on the edges. The rows are still added to the graph in
+ * file order, so the vertex ids do not depend on the number of threads.
+ *
+ * If the @c engine option is @c blocks, the data is not sharded if the input
+ * is grouped by query (as LETOR files usually are): the queries are written
+ * directly into the query block store in a single pass, as their vertex ids
+ * are increasing. If a query turns up again later, the blocks written so far
+ * are replayed into the sharder, and the data is sharded as usual.
+ *
+ * The data can be filtered, as set in @p ingest. Dropping the constant
+ * queries or features takes an extra pass over the input, in which the
+ * IngestStats are collected; nothing is written before the filters are
+ * known. The static features in @p ingest are stored once per document id,
+ * in the StaticFeatureTable of the dataset; formats without document ids
+ * cannot have static features, so they are kept on the edges. The metadata
+ * of the queries is saved in its QueryTable.
+ *
+ * @param[in] factory creates the reader object(s).
  * @param[in] file_name the name of the file.
- * @param[out] dimensions the number of features is written to this parameter.
+ * @param[in,out] dimensions the number of features is written to this
+ *                           parameter. In sparse mode, it is never less than
+ *                           the original value, unless the features are
+ *                           mapped.
+ * @param[in] ingest the filters.
+ * @param[in] has_doc_ids whether the format has document ids; the
+ *                        @c HAS_DOC_IDS of the reader class.
+ * @return the number of shards, or @c QUERY_BLOCKS_ONLY.
  */
-int read_inner(InputFileReader& reader,
-               const std::string& file_name, size_t& dimensions) {
+int read_inner(const ReaderFactory& factory,
+               const std::string& file_name, size_t& dimensions,
+               const IngestOptions& ingest, bool has_doc_ids) {
   int nshards;
-  sharder<double, EHeader> sharderobj(file_name);
-  sharderobj.start_preprocessing();
+  bool sparse = get_option_int("sparse", 0) != 0;
+  int ingest_threads = get_option_int("ingest_threads", 1);
+  size_t ingest_chunk =
+      static_cast<size_t>(get_option_int("ingest_chunk_mb", 64)) << 20;
+  /* The features are converted to feature_t here. */
+  std::vector<feature_t> features;
+
+  /* The filters. */
+  IngestStats stats;
+  if (ingest.drop_constant_queries || ingest.drop_constant_features) {
+    IdInterner stats_qids;
+    BlockHandler handler = [&](const QueryBlock& block) {
+      uint32_t query_index;
+      stats_qids.intern(block.qid, query_index);
+      for (size_t i = 0; i < block.size(); i++) {
+        features.assign(block.row_begin(i), block.row_end(i));
+        stats.add_row(query_index, block.relevance[i], features, sparse);
+      }
+    };
+    QueryBlockReader(factory, ingest_threads, ingest_chunk, sparse)
+        .read(handler);
+  }
+  FeatureMap feature_map;
+  bool map_features = false;
+  if (ingest.drop_constant_features) {
+    feature_map = stats.constant_feature_map();
+    map_features = true;
+    if (!feature_map.save(file_name)) {
+      logstream(LOG_WARNING) << "Could not save the feature map of "
+                             << file_name << std::endl;
+    }
+  } else if (!ingest.feature_map_of.empty()) {
+    if (!feature_map.load(ingest.feature_map_of)) {
+      logstream(LOG_FATAL) << "Cannot load the feature map of "
+                           << ingest.feature_map_of << std::endl;
+    }
+    map_features = true;
+  }
+  /*
+   * The static features, after the feature map. Without document ids, each
+   * edge would get a row of its own in the table, so they stay on the edges.
+   */
+  std::vector<size_t> static_features;
+  bool split_static = !ingest.static_features.empty();
+  if (split_static && !has_doc_ids) {
+    logstream(LOG_WARNING) << file_name << " has no document ids; the static "
+                           << "features are kept on the edges." << std::endl;
+    split_static = false;
+  }
+  for (size_t i = 0; split_static && i < ingest.static_features.size(); i++) {
+    size_t feature = ingest.static_features[i];
+    if (map_features) {
+      if (feature_map[feature] == FeatureMap::DROPPED) continue;
+      feature = static_cast<size_t>(feature_map[feature]);
+    }
+    static_features.push_back(feature);
+  }
+  StaticColumns static_columns(static_features);
+  StaticFeatureTable static_table;
+  static_table.reset(static_columns.size());
+  std::vector<feature_t> static_row;
+  size_t static_values = 0;
+  if (static_columns.empty()) {
+    remove(StaticFeatureTable::table_name(file_name).c_str());
+  }
+  /* What the filters dropped. */
+  size_t dropped_queries = 0;
+  size_t dropped_rows    = 0;
+  size_t bytes_saved     = 0;
+  std::unique_ptr<sharder<feature_t, EHeader> > sharderobj;
 
-  /* For read_line. */
-  std::string qid;
-  int relevance;
-  std::vector<double> features;
+  /* The query block store, while the input is grouped by query. */
+  bool direct = get_option_string("engine", "graphchi") == "blocks";
+  std::string store_name = QueryBlockStore::store_name(file_name);
+  QueryBlockStoreWriter writer;
+  if (direct) {
+    /* The store is bound to the manifest by read_cached(). */
+    direct = open_query_block_writer(writer, store_name, 0);
+  }
+  if (!direct) {
+    sharderobj.reset(new sharder<feature_t, EHeader>(file_name));
+    sharderobj->start_preprocessing();
+  }
+  /* The query being written to the store. */
+  vid_t pending_query = 0;
+  std::vector<DocRecord> pending_docs;
+  std::vector<feature_t> pending_features;
 
   vid_t curr_node = 0;  // The current node
-  size_t line     = 0;  // The number of the current line
-  std::map<std::string, vid_t> qids;
+  size_t ordinal  = 0;  // The edge ordinal; see EHeader
+  /*
+   * The vertex ids of the queries, by interned qid. Used to find the query
+   * of rows that are not contiguous in the file, and saved for scheduling.
+   */
+  IdInterner qids;
+  std::vector<vid_t> query_vids;
+  /* The "vertex id" of the dropped queries. */
+  const vid_t DROPPED_QUERY = static_cast<vid_t>(-1);
+  /* The metadata of the queries. */
+  QueryTableBuilder query_table;
   TypeVertex vertex_data;
 
   /* The vertex data file. */
   std::string filename = filename_vertex_data<TypeVertex>(file_name);
   FILE* f = fopen(filename.c_str(), "w");
 
-  while (reader.read_line(qid, qid, relevance, features)) {
-    dimensions = reader.num_features();
-
+  /* The pending query is only dropped once it is in the store. */
+  auto flush_pending = [&]() -> bool {
+    if (!pending_docs.empty() &&
+        !writer.add_block(pending_query, pending_docs, pending_features)) {
+      return false;
+    }
+    pending_docs.clear();
+    pending_features.clear();
+    return true;
+  };
+  /*
+   * Switches from the store to the sharder: replays the blocks in the store,
+   * and adds the pending query, which is not in it.
+   */
+  auto fall_back = [&]() {
+    direct = false;
+    sharderobj.reset(new sharder<feature_t, EHeader>(file_name));
+    sharderobj->start_preprocessing();
+    if (!writer.close(curr_node) ||
+        !replay_query_blocks(store_name, *sharderobj)) {
+      logstream(LOG_FATAL) << "Cannot replay the query blocks of "
+                           << file_name << std::endl;
+    }
+    remove(store_name.c_str());
+    std::vector<feature_t> doc_features;
+    const feature_t* values = pending_features.data();
+    for (size_t d = 0; d < pending_docs.size(); d++) {
+      const DocRecord& doc = pending_docs[d];
+      doc_features.assign(values, values + doc.length);
+      EHeader hdr(doc.relevance, doc.ordinal, doc.sparse != 0,
+                  doc.static_row);
+      sharderobj->preprocessing_add_edge_multival(pending_query, doc.doc, hdr,
+                                                  doc_features);
+      values += doc.length;
+    }
+    pending_docs.clear();
+    pending_features.clear();
+  };
+  BlockHandler handler = [&](const QueryBlock& block) {
     vid_t qid_i;
-    vid_t doc_i;
+    uint32_t query_index;
+    bool new_query = qids.intern(block.qid, query_index);
+    if (ingest.drop_constant_queries && stats.constant_query(query_index)) {
+      if (new_query) {
+        query_vids.push_back(DROPPED_QUERY);
+        dropped_queries++;
+      }
+      for (size_t i = 0; i < block.size(); i++) {
+        bytes_saved += block.row_length(i) * sizeof(feature_t) +
+                       sizeof(EHeader);
+      }
+      dropped_rows += block.size();
+      return;
+    }
+    if (new_query) {
+      /* Write the vertex data. */
+      vertex_data = TypeVertex(QUERY);
+      fwrite(&vertex_data, sizeof(TypeVertex), 1, f);
+      qid_i = curr_node++;
+      query_vids.push_back(qid_i);
+      if (direct && !flush_pending()) {
+        logstream(LOG_WARNING) << "Cannot write the query block store of "
+                               << file_name << "; sharding it." << std::endl;
+        fall_back();
+      }
+      pending_query = qid_i;
+    } else {
+      qid_i = query_vids[query_index];
+      if (direct && qid_i != pending_query) {
+        logstream(LOG_INFO) << file_name << " is not grouped by query; "
+                            << "sharding it." << std::endl;
+        fall_back();
+      }
+    }
 
-    if (qids.find(qid) == qids.end()) {
+    for (size_t i = 0; i < block.size(); i++) {
+      features.assign(block.row_begin(i), block.row_end(i));
+      if (map_features) {
+        bytes_saved += features.size() * sizeof(feature_t);
+        feature_map.apply(features, sparse);
+        bytes_saved -= features.size() * sizeof(feature_t);
+      }
+      update_dimensions(dimensions, features, sparse);
+      uint32_t static_index = 0;
+      if (!static_columns.empty()) {
+        static_columns.split(features, sparse, static_row);
+        static_index = static_table.add(block.docs[i], static_row);
+        static_values += static_row.size();
+      }
+
+      vid_t doc_i = curr_node++;
       /* Write the vertex data. */
-      vertex_data = TypeVertex(qid.c_str(), QUERY);
+      vertex_data = TypeVertex(DOCUMENT);
       fwrite(&vertex_data, sizeof(TypeVertex), 1, f);
-      qids[qid] = curr_node++;
+
+      EHeader hdr(block.relevance[i], static_cast<uint32_t>(ordinal++),
+                  sparse, static_index);
+      query_table.add(query_index, hdr.relevance);
+      if (direct) {
+        DocRecord doc;
+        doc.relevance  = hdr.relevance;
+        doc.sparse     = sparse ? 1 : 0;
+        doc.doc        = doc_i;
+        doc.ordinal    = hdr.ordinal;
+        doc.length     = static_cast<uint32_t>(features.size());
+        doc.static_row = hdr.static_row;
+        doc.padding    = 0;
+        pending_docs.push_back(doc);
+        pending_features.insert(pending_features.end(),
+                                features.begin(), features.end());
+      } else {
+        sharderobj->preprocessing_add_edge_multival(qid_i, doc_i, hdr,
+                                                    features);
+      }
     }
-    qid_i = qids[qid];
-    doc_i = curr_node++;
-    /* Write the vertex data. */
-    vertex_data = TypeVertex(line++, DOCUMENT);
-    fwrite(&vertex_data, sizeof(TypeVertex), 1, f);
+  };
+  QueryBlockReader reader(factory, ingest_threads, ingest_chunk, sparse);
+  reader.read(handler);
 
-    // DEBUG only
-    EHeader hdr(relevance, doc_i);
-//    sharderobj.preprocessing_add_edge(qid_i, doc_i, edge_data);
-    sharderobj.preprocessing_add_edge_multival(qid_i, doc_i, hdr, features);
+  fclose(f);
+  if (map_features) {
+    dimensions = feature_map.dimensions();
+  }
+  if (!static_columns.empty()) {
+    /* The static features come after the edge features. */
+    dimensions = std::max(dimensions, *std::max_element(
+        static_features.begin(), static_features.end()) + 1);
+    static_table.set_edge_dimensions(dimensions - static_columns.size());
+    if (!static_table.save(file_name)) {
+      logstream(LOG_FATAL) << "Cannot save the static features of "
+                           << file_name << std::endl;
+    }
+    logstream(LOG_INFO) << "Stored " << static_columns.size()
+                        << " static features of " << static_table.rows()
+                        << " documents once: "
+                        << (static_values - static_table.rows() *
+                                                static_table.width()) *
+                               sizeof(feature_t)
+                        << " bytes less edge data." << std::endl;
+  }
+  if (!query_table.save(file_name, query_vids)) {
+    logstream(LOG_FATAL) << "Cannot save the query table of " << file_name
+                         << std::endl;
+  }
+  if (dropped_queries > 0 || !feature_map.identity()) {
+    query_vids.erase(std::remove(query_vids.begin(), query_vids.end(),
+                                 DROPPED_QUERY),
+                     query_vids.end());
+    logstream(LOG_INFO) << "Dropped " << dropped_queries << " queries ("
+                        << dropped_rows << " documents) without document "
+                        << "pairs and " << (feature_map.input_dimensions() -
+                                            feature_map.dimensions())
+                        << " constant features of " << file_name << ": "
+                        << bytes_saved << " bytes less edge data."
+                        << std::endl;
+  }
+  if (!save_query_vertices(file_name, query_vids)) {
+    logstream(LOG_WARNING) << "Could not save the query vertices of "
+                           << file_name << std::endl;
   }
 
-  fclose(f);
+  if (direct) {
+    if (!flush_pending() || !writer.close(curr_node)) {
+      logstream(LOG_FATAL) << "Cannot write the query block store of "
+                           << file_name << std::endl;
+    }
+    logstream(LOG_INFO) << "Wrote the " << query_vids.size() << " queries of "
+                        << file_name << " directly into the query block "
+                        << "store." << std::endl;
+    return QUERY_BLOCKS_ONLY;
+  }
 
-  sharderobj.end_preprocessing();
+  sharderobj->end_preprocessing();
 
   /*
    * Shard with a specified number of shards, or determine automatically if not
    * defined
    */
-  nshards = sharderobj.execute_sharding(get_option_string("nshards", "auto"));
+  nshards = sharderobj->execute_sharding(get_option_string("nshards", "auto"));
 
   return nshards;
 }
 
 /**
- * Reads the LETOR format.
+ * Reads the data from a csv file. The document and query ids can be strings;
+ * all features are converted to doubles. See read_inner().
  *
  * @param file_name the name of the file.
- * @param[out] dimensions the number of features is written to this parameter.
+ * @param[in,out] dimensions the number of features is written to this
+ *                           parameter.
+ * @param qid_col the column of the query id. 0 by default.
+ * @param doc_col the column of the document id. 1 by default.
+ * @param rel_col the column with the relevance level; by default, the last one.
+ * @param has_header if true, the first row is disregarded.
+ * @param ingest the filters.
+ * @return the number of shards.
+ */
+int read_csv(const std::string& file_name, size_t& dimensions,
+             int qid_col=0, int doc_col=1, int rel_col=-1,
+             bool has_header=true,
+             const IngestOptions& ingest=IngestOptions()) {
+  ReaderFactory factory = [&]() -> InputFileReader* {
+    return new CsvReader(file_name, qid_col, doc_col, rel_col, has_header);
+  };
+  return read_inner(factory, file_name, dimensions, ingest,
+                    CsvReader::HAS_DOC_IDS);
+}
+
+/**
+ * Reads the LETOR format. The number of features is determined by a pre-scan
+ * of the file.
+ *
+ * @param file_name the name of the file.
+ * @param[in,out] dimensions at least this many features are read (so that
+ *                           e.g. the test set matches the training set); the
+ *                           number of features is written to this parameter.
+ * @param ingest the filters.
  */
-int read_letor(const std::string& file_name, size_t& dimensions) {
-  LetorReader reader(file_name);
-  return read_inner(reader, file_name, dimensions);
+int read_letor(const std::string& file_name, size_t& dimensions,
+               const IngestOptions& ingest=IngestOptions()) {
+  size_t num_features = std::max(LetorReader(file_name).num_features(),
+                                 dimensions);
+  logstream(LOG_INFO) << "Number of features in " << file_name << ": "
+                      << num_features << std::endl;
+  ReaderFactory factory = [&]() -> InputFileReader* {
+    return new LetorReader(file_name, num_features);
+  };
+  dimensions = num_features;
+  return read_inner(factory, file_name, dimensions, ingest,
+                    LetorReader::HAS_DOC_IDS);
 }
 
 /**
@@ -164,8 +533,129 @@ int read_letor(const std::string& file_name, size_t& dimensions) {
  *
  * @param file_name the name of the file.
  * @param[out] dimensions the number of features is written to this parameter.
+ * @param ingest the filters.
  */
-int read_yahoo_ltr(const std::string& file_name, size_t& dimensions) {
-  YahooChallengeReader reader(file_name);
-  return read_inner(reader, file_name, dimensions);
+int read_yahoo_ltr(const std::string& file_name, size_t& dimensions,
+                   const IngestOptions& ingest=IngestOptions()) {
+  ReaderFactory factory = [&]() -> InputFileReader* {
+    return new YahooChallengeReader(file_name);
+  };
+  return read_inner(factory, file_name, dimensions, ingest,
+                    YahooChallengeReader::HAS_DOC_IDS);
+}
+
+/**
+ * Reads a binary dataset written by ltr_convert; see BinaryDatasetReader.
+ *
+ * @param file_name the name of the file.
+ * @param[out] dimensions the number of features is written to this parameter.
+ * @param ingest the filters.
+ */
+int read_binary(const std::string& file_name, size_t& dimensions,
+                const IngestOptions& ingest=IngestOptions()) {
+  if (!BinaryDatasetReader(file_name).valid()) {
+    logstream(LOG_FATAL) << file_name << " is not a valid binary dataset; "
+                         << "binned datasets can only be used to train "
+                         << "lambdamart." << std::endl;
+  }
+  ReaderFactory factory = [&]() -> InputFileReader* {
+    return new BinaryDatasetReader(file_name);
+  };
+  return read_inner(factory, file_name, dimensions, ingest,
+                    BinaryDatasetReader::HAS_DOC_IDS);
+}
+
+/**
+ * Returns the number of shards of @p file_name if it has already been sharded
+ * from the same input and with the same options (see DatasetManifest), the
+ * shards (and the vertex data, query list and query table) still exist and
+ * they have at
+ * least @p dimensions features; 0 otherwise. In the former case, the number
+ * of features is written to @p dimensions. A dataset that was written
+ * directly into the query block store is reused if the store is still bound
+ * to its manifest; @c QUERY_BLOCKS_ONLY is returned then.
+ *
+ * @param[in] fingerprint the fingerprint of the input.
+ */
+inline int find_cached_shards(const std::string& file_name,
+                              const DatasetManifest& fingerprint,
+                              size_t& dimensions) {
+  DatasetManifest manifest;
+  if (!manifest.load(file_name) || !manifest.same_input(fingerprint) ||
+      manifest.nshards == 0 || manifest.dimensions < dimensions) {
+    return 0;
+  }
+  struct stat st;
+  if (manifest.nshards == QUERY_BLOCKS_ONLY) {
+    QueryBlockStore store;
+    if (!store.open(QueryBlockStore::store_name(file_name)) ||
+        store.manifest_hash() !=
+            hash_file(DatasetManifest::manifest_name(file_name))) {
+      return 0;
+    }
+  }
+  for (int p = 0; p < manifest.nshards; p++) {
+    std::string shard = filename_shard_adj(file_name, p, manifest.nshards);
+    if (stat(shard.c_str(), &st) != 0) return 0;
+  }
+  if (stat(filename_vertex_data<TypeVertex>(file_name).c_str(), &st) != 0 ||
+      stat(query_vertices_name(file_name).c_str(), &st) != 0 ||
+      stat(QueryTable::table_name(file_name).c_str(), &st) != 0) {
+    return 0;
+  }
+  dimensions = manifest.dimensions;
+  return manifest.nshards;
+}
+
+/**
+ * Reads and shards @p file_name by calling @p read, unless the shards of a
+ * previous run can be reused (see find_cached_shards()). After sharding, the
+ * manifest is saved next to the shards.
+ *
+ * Reuse can be disabled with the @c reuse_shards option.
+ *
+ * @param[in] options the options that affect the contents of the shards, e.g.
+ *                    the reader type and the column indices.
+ * @param[in,out] dimensions see the readers.
+ * @param[in] read the reader function, e.g. read_letor().
+ * @return the number of shards, or @c QUERY_BLOCKS_ONLY.
+ */
+inline int read_cached(const std::string& file_name,
+                       const std::string& options, size_t& dimensions,
+                       const std::function<int(size_t&)>& read) {
+  DatasetManifest manifest;
+  std::ostringstream all_options;
+  all_options << options << " nshards=" << get_option_string("nshards", "auto")
+              << " feature_size=" << sizeof(feature_t);
+  if (!manifest.fingerprint(file_name, all_options.str())) {
+    logstream(LOG_FATAL) << "Cannot read " << file_name << std::endl;
+  }
+  if (get_option_int("reuse_shards", 1) != 0) {
+    int nshards = find_cached_shards(file_name, manifest, dimensions);
+    if (nshards == QUERY_BLOCKS_ONLY) {
+      logstream(LOG_INFO) << "Reusing the query block store of "
+                          << file_name << "." << std::endl;
+      return nshards;
+    } else if (nshards > 0) {
+      logstream(LOG_INFO) << "Reusing the " << nshards << " shards of "
+                          << file_name << "." << std::endl;
+      return nshards;
+    }
+  }
+
+  manifest.nshards = read(dimensions);
+  manifest.dimensions = dimensions;
+  if (manifest.nshards != 0 && !manifest.save(file_name)) {
+    logstream(LOG_WARNING) << "Could not save the manifest of " << file_name
+                           << std::endl;
+  }
+  /* A store written while reading is bound to the manifest only now. */
+  if (manifest.nshards == QUERY_BLOCKS_ONLY &&
+      !QueryBlockStore::set_manifest_hash(
+          QueryBlockStore::store_name(file_name),
+          hash_file(DatasetManifest::manifest_name(file_name)))) {
+    logstream(LOG_FATAL) << "Cannot write the query block store of "
+                         << file_name << std::endl;
+  }
+  return manifest.nshards;
 }
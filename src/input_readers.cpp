@@ -26,23 +26,63 @@
 
 #include <iostream>
 #include "input_readers.h"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
 #include <set>
+#include <utility>
+#include <omp.h>
 //#include "graphchi_basic_includes.hpp"
 
 InputFileReader::InputFileReader(std::string file_name) {
-  open_file(file_name, ifs);
+  open_file(file_name);
 }
 
 InputFileReader::~InputFileReader() {
-  ifs.close();
+  file.close();
 }
 
-void InputFileReader::open_file(std::string name, std::ifstream& ifs) {
-  ifs.open(name.c_str());
-  if (!ifs) {
-    perror("open_file failed");
+void InputFileReader::open_file(std::string name) {
+  Compression compression = detect_compression(name);
+  if (compression != NO_COMPRESSION) {
+    compressed.reset(new CompressedLineSource());
+    if (!compressed->open(name, compression)) {
+//      logstream(LOG_FATAL) << "Failed to open file " << name << std::endl;
+    }
+    return;
+  }
+  if (!file.open(name)) {
 //    logstream(LOG_FATAL) << "Failed to open file " << name << std::endl;
   }
+  lines.reset(file.begin(), file.end());
+}
+
+bool InputFileReader::read_line_sparse(std::string& qid, std::string& doc,
+                                       int& rel,
+                                       std::vector<double>& features) {
+  if (!read_line(qid, doc, rel, dense)) return false;
+  features.clear();
+  for (size_t i = 0; i < dense.size(); i++) {
+    if (dense[i] != 0) {
+      features.push_back(i);
+      features.push_back(dense[i]);
+    }
+  }
+  return true;
+}
+
+void InputFileReader::set_range(size_t begin, size_t end) {
+  lines.reset(file.begin() + begin, file.begin() + end);
+  start_range(begin == 0);
+}
+
+size_t InputFileReader::next_line_start(size_t offset) const {
+  if (offset == 0 || offset >= file.size()) {
+    return std::min(offset, file.size());
+  }
+  /* offset - 1: offset might already be at the beginning of a line. */
+  const char* nl = find_char(file.begin() + offset - 1, file.end(), '\n');
+  return nl == file.end() ? file.size() : nl - file.begin() + 1;
 }
 
 CsvReader::CsvReader(const std::string& file_name, int qid_col, int doc_col,
@@ -50,7 +90,17 @@ CsvReader::CsvReader(const std::string& file_name, int qid_col, int doc_col,
     : InputFileReader(file_name), qid_col(qid_col), doc_col(doc_col),
       rel_col(rel_col), has_header(has_header), first_line(true) {
   if (has_header) {
-    std::getline(ifs, line);
+    const char* begin;
+    const char* end;
+    next_line(begin, end);
+  }
+}
+
+void CsvReader::start_range(bool at_file_start) {
+  if (at_file_start && has_header) {
+    const char* begin;
+    const char* end;
+    next_line(begin, end);
   }
 }
 
@@ -60,27 +110,26 @@ bool CsvReader::read_line(std::string& qid, std::string& doc, int& rel,
     first_line = false;
     return read_first_line(qid, doc, rel, features);
   } else {
-    std::getline(ifs, line);
-    if (!ifs) return false;
+    const char* line_begin;
+    const char* line_end;
+    if (!next_line(line_begin, line_end)) return false;
 
-    ss.clear();
-    ss.str(line);
-    std::string token;
+    FieldTokenizer fields(line_begin, line_end, ',', ',');
+    const char* begin;
+    const char* end;
     features.clear();
-    for (int i = 0; ; i++) {
-      std::getline(ss, token, ',');
-      if (!ss) break;
+    for (int i = 0; fields.next(begin, end); i++) {
       if (i == qid_col) {
-        qid = token;
+        qid.assign(begin, end);
       } else if (i == doc_col) {
-        doc = token;
+        doc.assign(begin, end);
       } else if (i != rel_col) {
-        features.push_back(atof(token.c_str()));
+        features.push_back(parse_double(begin, end));
       }
       /* rel can be anything (e.g. if there is no such column, but we need to
        * specify it anyway). */
       if (i == rel_col) {
-        rel = atoi(token.c_str());
+        rel = parse_int(begin, end);
       }
     }
     return true;
@@ -89,19 +138,18 @@ bool CsvReader::read_line(std::string& qid, std::string& doc, int& rel,
 
 bool CsvReader::read_first_line(std::string& qid, std::string& doc, int& rel,
                                 std::vector<double>& features) {
-  std::getline(ifs, line);
-  if (!ifs) return false;
+  const char* line_begin;
+  const char* line_end;
+  if (!next_line(line_begin, line_end)) return false;
 
-  ss.clear();
-  ss.str(line);
-  std::string token;
+  typedef std::pair<const char*, const char*> Field;
+  FieldTokenizer fields(line_begin, line_end, ',', ',');
+  Field field;
   features.clear();
 
-  std::vector<std::string> string_fields;
-  while (true) {
-    std::getline(ss, token, ',');
-    if (!ss) break;
-    string_fields.push_back(token);
+  std::vector<Field> string_fields;
+  while (fields.next(field.first, field.second)) {
+    string_fields.push_back(field);
   }
 
   while (qid_col < 0) {
@@ -113,9 +161,9 @@ bool CsvReader::read_first_line(std::string& qid, std::string& doc, int& rel,
   while (rel_col < 0) {
     rel_col += string_fields.size();
   }
-  qid = string_fields[qid_col];
-  doc = string_fields[doc_col];
-  rel = atoi(string_fields[rel_col].c_str());
+  qid.assign(string_fields[qid_col].first, string_fields[qid_col].second);
+  doc.assign(string_fields[doc_col].first, string_fields[doc_col].second);
+  rel = parse_int(string_fields[rel_col].first, string_fields[rel_col].second);
   std::set<int> to_remove;
   to_remove.insert(qid_col);
   to_remove.insert(doc_col);
@@ -125,40 +173,116 @@ bool CsvReader::read_first_line(std::string& qid, std::string& doc, int& rel,
     string_fields.erase(string_fields.begin() + *it);
   }
 
-  for (std::vector<std::string>::const_iterator it = string_fields.begin();
+  for (std::vector<Field>::const_iterator it = string_fields.begin();
       it != string_fields.end(); ++it) {
-    features.push_back(atof(it->c_str()));
+    features.push_back(parse_double(it->first, it->second));
   }
   return true;
 }
 
-LetorReader::LetorReader(const std::string& file_name)
-  : InputFileReader(file_name) {}
+LetorReader::LetorReader(const std::string& file_name, size_t num_features)
+  : InputFileReader(file_name), vector_length(num_features) {
+  if (vector_length == 0) {
+    vector_length = scan_num_features();
+    /* Rewind. */
+    if (seekable()) {
+      set_range(0, file_size());
+    } else {
+      open_file(file_name);
+    }
+  }
+}
 
-size_t LetorReader::VECTOR_LENGTH = 136;
+size_t LetorReader::scan_num_features() {
+  size_t max_index = 0;
+  const char* line_begin;
+  const char* line_end;
+  while (next_line(line_begin, line_end)) {
+    const char* p = find_char(line_begin, line_end, '#');
+    /* The last colon on the line... */
+    while (p > line_begin && *(p - 1) != ':') p--;
+    if (p == line_begin) continue;
+    const char* colon = p - 1;
+    /* ... and the index before it. */
+    const char* begin = colon;
+    while (begin > line_begin && *(begin - 1) != ' ' && *(begin - 1) != '\t') {
+      begin--;
+    }
+    if (colon - begin == 3 && begin[0] == 'q' && begin[1] == 'i' &&
+        begin[2] == 'd') {
+      continue;  // No features on the line
+    }
+    size_t index = static_cast<size_t>(parse_int(begin, colon));
+    if (index > max_index) max_index = index;
+  }
+  return max_index;
+}
 
 bool LetorReader::read_line(std::string& qid, std::string& doc, int& rel,
                             std::vector<double>& features) {
-  std::getline(ifs, line);
-  if (!ifs) return false;
-
-  ss.clear();
-  ss.str(line);
-  std::string token;
-  features.resize(VECTOR_LENGTH);
-  for (int i = 0; ; i++) {
-    std::getline(ss, token, ' ');
-    if (!ss) break;
-    if (i == 0) {
-      rel = atoi(token.c_str());
+  const char* line_begin;
+  const char* line_end;
+  if (!next_line(line_begin, line_end)) return false;
+
+  FieldTokenizer fields(line_begin, line_end, ' ', '\t');
+  const char* begin;
+  const char* end;
+  /* Features missing from the line are 0. */
+  features.assign(vector_length, 0);
+  bool first = true;
+  while (fields.next(begin, end)) {
+    if (begin == end) continue;  // Multiple spaces
+    if (*begin == '#') break;    // Comment until the end of the line
+    if (first) {
+      rel = parse_int(begin, end);
+      first = false;
+    } else {
+      const char* colon = find_char(begin, end, ':');
+      if (colon == end) continue;
+      if (colon - begin == 3 && begin[0] == 'q' && begin[1] == 'i' &&
+          begin[2] == 'd') {
+        qid.assign(colon + 1, end);
+      } else {
+        size_t index = static_cast<size_t>(parse_int(begin, colon));
+        if (index >= 1 && index <= vector_length) {
+          features[index - 1] = parse_double(colon + 1, end);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool LetorReader::read_line_sparse(std::string& qid, std::string& doc,
+                                   int& rel, std::vector<double>& features) {
+  const char* line_begin;
+  const char* line_end;
+  if (!next_line(line_begin, line_end)) return false;
+
+  FieldTokenizer fields(line_begin, line_end, ' ', '\t');
+  const char* begin;
+  const char* end;
+  features.clear();
+  bool first = true;
+  while (fields.next(begin, end)) {
+    if (begin == end) continue;  // Multiple spaces
+    if (*begin == '#') break;    // Comment until the end of the line
+    if (first) {
+      rel = parse_int(begin, end);
+      first = false;
     } else {
-      size_t pos = token.find(":");
-      std::string pos_str = token.substr(0, pos);
-      std::string val_str = token.substr(pos + 1);
-      if (pos_str == "qid") {
-        qid = val_str;
+      const char* colon = find_char(begin, end, ':');
+      if (colon == end) continue;
+      if (colon - begin == 3 && begin[0] == 'q' && begin[1] == 'i' &&
+          begin[2] == 'd') {
+        qid.assign(colon + 1, end);
       } else {
-        features[atoi(pos_str.c_str())] = atof(val_str.c_str());
+        size_t index = static_cast<size_t>(parse_int(begin, colon));
+        double value = parse_double(colon + 1, end);
+        if (index >= 1 && index <= vector_length && value != 0) {
+          features.push_back(index - 1);
+          features.push_back(value);
+        }
       }
     }
   }
@@ -173,22 +297,21 @@ bool YahooChallengeReader::read_line(std::string& qid, std::string& doc,
   if (vector_length == 0) {
     return read_first_line(qid, doc, rel, features);
   } else {
-    std::getline(ifs, line);
-    if (!ifs) return false;
+    const char* line_begin;
+    const char* line_end;
+    if (!next_line(line_begin, line_end)) return false;
 
-    ss.clear();
-    ss.str(line);
-    std::string token;
+    FieldTokenizer fields(line_begin, line_end, ',', ',');
+    const char* begin;
+    const char* end;
     features.resize(vector_length);
-    for (size_t i = 0; ; i++) {
-      std::getline(ss, token, ',');
-      if (!ss) break;
+    for (size_t i = 0; fields.next(begin, end); i++) {
       if (i == 0) {
-        qid = token;
+        qid.assign(begin, end);
       } else if (i == vector_length + 1) {
-        rel = atoi(token.c_str());
-      } else {
-        features[i - 1] = atof(token.c_str());
+        rel = parse_int(begin, end);
+      } else if (i <= vector_length) {
+        features[i - 1] = parse_double(begin, end);
       }
     }
     return true;
@@ -198,20 +321,19 @@ bool YahooChallengeReader::read_line(std::string& qid, std::string& doc,
 bool YahooChallengeReader::read_first_line(std::string& qid, std::string& doc,
                                            int& rel,
                                            std::vector<double>& features) {
-  std::getline(ifs, line);
-  if (!ifs) return false;
+  const char* line_begin;
+  const char* line_end;
+  if (!next_line(line_begin, line_end)) return false;
 
-  ss.clear();
-  ss.str(line);
-  std::string token;
+  FieldTokenizer fields(line_begin, line_end, ',', ',');
+  const char* begin;
+  const char* end;
   features.resize(0);
-  for (size_t i = 0; ; i++) {
-    std::getline(ss, token, ',');
-    if (!ss) break;
+  for (size_t i = 0; fields.next(begin, end); i++) {
     if (i == 0) {
-      qid = token;
+      qid.assign(begin, end);
     } else {
-      features.push_back(atof(token.c_str()));
+      features.push_back(parse_double(begin, end));
     }
   }
   if (features.size() == 0) return false;
@@ -221,3 +343,235 @@ bool YahooChallengeReader::read_first_line(std::string& qid, std::string& doc,
   return true;
 }
 
+BinaryDatasetReader::BinaryDatasetReader(const std::string& file_name)
+  : InputFileReader(file_name), row(0), qids(NULL), relevance(NULL),
+    data(NULL) {
+  if (compressed.get() != NULL || file.size() < sizeof(header)) return;
+  header = *reinterpret_cast<const BinaryDatasetHeader*>(file.begin());
+  if (!header.valid(file.size()) || header.scalar_size != sizeof(feature_t)) {
+    return;
+  }
+  qids      = reinterpret_cast<const int32_t*>(file.begin() + header.qids_pos);
+  relevance = reinterpret_cast<const double*>(
+      file.begin() + header.relevance_pos);
+  data      = reinterpret_cast<const feature_t*>(
+      file.begin() + header.features_pos);
+}
+
+bool BinaryDatasetReader::read_line(std::string& qid, std::string& doc,
+                                    int& rel, std::vector<double>& features) {
+  if (!valid() || row >= header.rows) return false;
+  char buffer[16];
+  qid.assign(buffer, snprintf(buffer, sizeof(buffer), "%d", qids[row]));
+  rel = static_cast<int>(relevance[row]);
+  features.resize(header.dimensions);
+  for (size_t f = 0; f < header.dimensions; f++) {
+    features[f] = data[f * header.rows + row];
+  }
+  row++;
+  return true;
+}
+
+namespace {
+
+/**
+ * The rows read from a chunk of the input file by a thread in read_rows().
+ * Everything is stored in flat arrays to avoid per-row allocations.
+ */
+struct RowChunk {
+  /** The query and document ids, concatenated. */
+  std::string ids;
+  /** The end of the query and document id of each row in @c ids. */
+  std::vector<size_t> id_ends;
+  /** The relevance of each row. */
+  std::vector<int> rels;
+  /** The features of all rows, concatenated. */
+  std::vector<double> features;
+  /** The end of the features of each row in @c features. */
+  std::vector<size_t> feature_ends;
+
+  void clear() {
+    ids.clear();
+    id_ends.clear();
+    rels.clear();
+    features.clear();
+    feature_ends.clear();
+  }
+
+  /** Reads all rows in the current range of @p reader. */
+  void read(InputFileReader& reader, bool sparse) {
+    std::string qid;
+    std::string doc;
+    int rel;
+    std::vector<double> row;
+    while (sparse ? reader.read_line_sparse(qid, doc, rel, row)
+                  : reader.read_line(qid, doc, rel, row)) {
+      ids.append(qid);
+      id_ends.push_back(ids.size());
+      ids.append(doc);
+      id_ends.push_back(ids.size());
+      rels.push_back(rel);
+      features.insert(features.end(), row.begin(), row.end());
+      feature_ends.push_back(features.size());
+    }
+  }
+
+  /** Passes all rows to @p handler. */
+  void replay(const RowHandler& handler) const {
+    std::string qid;
+    std::string doc;
+    std::vector<double> row;
+    size_t id_begin = 0;
+    size_t feature_begin = 0;
+    for (size_t i = 0; i < rels.size(); i++) {
+      qid.assign(ids, id_begin, id_ends[2 * i] - id_begin);
+      doc.assign(ids, id_ends[2 * i], id_ends[2 * i + 1] - id_ends[2 * i]);
+      id_begin = id_ends[2 * i + 1];
+      row.assign(features.begin() + feature_begin,
+                 features.begin() + feature_ends[i]);
+      feature_begin = feature_ends[i];
+      handler(qid, doc, rels[i], row);
+    }
+  }
+};
+
+/**
+ * Splits the file of @p probe into (at most) @p num_chunks chunks, so that no
+ * query is split between two chunks. Since the qids must be read to find the
+ * query boundaries, @p probe is left in an unspecified position.
+ *
+ * @return the chunk boundaries, including 0 and the file size.
+ */
+std::vector<size_t> query_aligned_boundaries(InputFileReader& probe,
+                                             size_t num_chunks) {
+  size_t size = probe.file_size();
+  std::vector<size_t> boundaries(1, 0);
+  std::string qid;
+  std::string next_qid;
+  std::string doc;
+  int rel;
+  std::vector<double> features;
+  for (size_t i = 1; i < num_chunks; i++) {
+    size_t pos = probe.next_line_start(size / num_chunks * i);
+    if (pos <= boundaries.back()) continue;  // inside the previous query
+    /* Move pos forward to the first line of the next query. */
+    probe.set_range(pos, size);
+    if (probe.read_line(qid, doc, rel, features)) {
+      while (true) {
+        pos = probe.position();
+        if (!probe.read_line(next_qid, doc, rel, features)) {
+          pos = size;
+          break;
+        }
+        if (next_qid != qid) break;
+      }
+    } else {
+      pos = size;
+    }
+    if (pos >= size) break;
+    boundaries.push_back(pos);
+  }
+  boundaries.push_back(size);
+  return boundaries;
+}
+
+}  // namespace
+
+void read_rows(const ReaderFactory& factory, const RowHandler& handler,
+               int num_threads, size_t chunk_size, bool sparse) {
+  std::unique_ptr<InputFileReader> first(factory());
+
+  if (num_threads <= 1 || !first->seekable()) {
+    std::string qid;
+    std::string doc;
+    int rel;
+    std::vector<double> features;
+    while (sparse ? first->read_line_sparse(qid, doc, rel, features)
+                  : first->read_line(qid, doc, rel, features)) {
+      handler(qid, doc, rel, features);
+    }
+    return;
+  }
+
+  size_t num_chunks = std::max(first->file_size() / std::max(chunk_size,
+                                                             size_t(1)) + 1,
+                               static_cast<size_t>(num_threads));
+  std::vector<size_t> boundaries = query_aligned_boundaries(*first, num_chunks);
+  num_chunks = boundaries.size() - 1;
+
+  /* One reader and one chunk buffer per thread. */
+  std::vector<InputFileReader*> readers(num_threads);
+  readers[0] = first.release();
+  for (int t = 1; t < num_threads; t++) {
+    readers[t] = factory();
+  }
+  std::vector<RowChunk> chunks(num_threads);
+
+  /* Rounds of num_threads chunks: parse in parallel, then replay in order. */
+  for (size_t round = 0; round < num_chunks; round += num_threads) {
+    int in_round = static_cast<int>(
+        std::min(num_chunks - round, static_cast<size_t>(num_threads)));
+#pragma omp parallel for num_threads(in_round) schedule(static, 1)
+    for (int t = 0; t < in_round; t++) {
+      chunks[t].clear();
+      readers[t]->set_range(boundaries[round + t], boundaries[round + t + 1]);
+      chunks[t].read(*readers[t], sparse);
+    }
+    for (int t = 0; t < in_round; t++) {
+      chunks[t].replay(handler);
+    }
+  }
+
+  for (int t = 0; t < num_threads; t++) {
+    delete readers[t];
+  }
+}
+
+QueryBlock::QueryBlock() : offsets(1, 0) {}
+
+void QueryBlock::clear() {
+  qid.clear();
+  docs.clear();
+  relevance.clear();
+  features.clear();
+  offsets.resize(1);
+}
+
+void QueryBlock::add_row(const std::string& doc, int rel,
+                         const std::vector<double>& row) {
+  docs.push_back(doc);
+  relevance.push_back(rel);
+  features.insert(features.end(), row.begin(), row.end());
+  offsets.push_back(features.size());
+}
+
+bool QueryBlock::uniform() const {
+  for (size_t i = 1; i < size(); i++) {
+    if (row_length(i) != row_length(0)) return false;
+  }
+  return true;
+}
+
+QueryBlockReader::QueryBlockReader(const ReaderFactory& factory_,
+                                   int num_threads_, size_t chunk_size_,
+                                   bool sparse_)
+  : factory(factory_), num_threads(num_threads_), chunk_size(chunk_size_),
+    sparse(sparse_) {}
+
+void QueryBlockReader::read(const BlockHandler& handler) {
+  QueryBlock block;
+  read_rows(factory, [&](const std::string& qid, const std::string& doc,
+                         int rel, std::vector<double>& features) {
+    if (block.size() > 0 && qid != block.qid) {
+      handler(block);
+      block.clear();
+    }
+    if (block.size() == 0) {
+      block.qid = qid;
+    }
+    block.add_row(doc, rel, features);
+  }, num_threads, chunk_size, sparse);
+  if (block.size() > 0) {
+    handler(block);
+  }
+}
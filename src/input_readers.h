@@ -26,17 +26,21 @@
  */
 #include <cstdlib>
 
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <vector>
 
+#include "compressed_input.h"
+#include "tokenizer.h"
+#include "ml/binary_dataset.h"
+
 class InputFileReader {
 public:
   InputFileReader(std::string file_name);
 
-  ~InputFileReader();
+  virtual ~InputFileReader();
 
   /**
    * Reads a line; returns the query and doc ids and the features in it.
@@ -48,6 +52,17 @@ public:
   virtual bool read_line(std::string& qid, std::string& doc, int& rel,
                          std::vector<double>& features)=0;
 
+  /**
+   * Same as read_line(), but returns the features in sparse form: only the
+   * non-zero features are returned, as (index, value) pairs packed into
+   * @p features, i.e. <tt>index0, value0, index1, value1, ...</tt>
+   *
+   * This default implementation calls read_line() and drops the zeros;
+   * readers of sparse formats should override it.
+   */
+  virtual bool read_line_sparse(std::string& qid, std::string& doc, int& rel,
+                                std::vector<double>& features);
+
   /**
    * Returns the number of features.
    *
@@ -55,15 +70,70 @@ public:
    */
   virtual size_t num_features()=0;
 
+  /**
+   * Whether the rows of the format have document ids. A property of the
+   * class, so that it can be checked without opening a file; readers of
+   * formats without document ids hide it with @c false.
+   */
+  static const bool HAS_DOC_IDS = true;
+
+  /**
+   * Whether the file can be read in ranges, i.e. whether set_range() and the
+   * offset-related methods below work. Compressed files can only be read
+   * sequentially.
+   */
+  virtual bool seekable() const { return compressed.get() == NULL; }
+
+  /**
+   * Restricts the reader to the byte range <tt>[begin, end)</tt> of the file.
+   * Both ends should be at line boundaries; see next_line_start().
+   */
+  void set_range(size_t begin, size_t end);
+
+  /** The size of the input file in bytes. */
+  inline size_t file_size() const { return file.size(); }
+
+  /** The offset of the line read_line() will return next. */
+  inline size_t position() const { return lines.position() - file.begin(); }
+
+  /** Returns the offset of the first line that starts at or after @p offset. */
+  size_t next_line_start(size_t offset) const;
+
 protected:
   /**
-   * Opens file @p name with error checking.
+   * Called by set_range(), so that subclasses can reset their state.
+   * @param[in] at_file_start whether the range starts at the beginning of the
+   *                          file (e.g. at the header).
+   */
+  virtual void start_range(bool at_file_start) {}
+
+  /**
+   * Opens file @p name with error checking. Uncompressed files are mapped
+   * into memory; gzip (and zstd) files are decompressed on the fly.
    * @param[in] name the name of the file.
-   * @param[out] ifs the @c ifstream "returned".
    */
-  void open_file(std::string name, std::ifstream& ifs);  // bool optional = false
+  void open_file(std::string name);  // bool optional = false
+
+  /**
+   * Returns the next line of the file in <tt>[line_begin, line_end)</tt>;
+   * see LineTokenizer::next_line().
+   */
+  inline bool next_line(const char*& line_begin, const char*& line_end) {
+    return compressed.get() == NULL ? lines.next_line(line_begin, line_end)
+                                    : compressed->next_line(line_begin,
+                                                            line_end);
+  }
+
+  /** The input file, mapped into memory. */
+  MmapFile file;
+  /** Iterates through the lines of @c file. */
+  LineTokenizer lines;
+  /** Used instead of @c file and @c lines if the file is compressed. */
+  std::unique_ptr<CompressedLineSource> compressed;
 
-  std::ifstream ifs;
+private:
+  /** The dense features for the default read_line_sparse(). */
+  std::vector<double> dense;
 };
 
 /** Reads a CSV file. */
@@ -82,6 +152,10 @@ public:
   /** Not implemented. */
   inline size_t num_features() { return 0; }
 
+protected:
+  /** Skips the header, if the range starts at the beginning of the file. */
+  void start_range(bool at_file_start);
+
 private:
   /**
    * Same as read_line(), but used used for the first line if any of
@@ -100,31 +174,47 @@ private:
   /** If the first line is the headers. */
   bool has_header;
 
-  /** Lines are read into this. */
-  std::string line;
-  /** Object for field separation. */
-  std::stringstream ss;
   /** First line? */
   bool first_line;
 };
 
+/**
+ * Reads the LETOR (SVMlight) format. Feature indices are 1-based in the file;
+ * feature @c i is returned at index <tt>i - 1</tt>.
+ */
 class LetorReader : public InputFileReader {
 public:
-  LetorReader(const std::string& file_name);
+  /**
+   * @param num_features the number of features. If 0, the file is pre-scanned
+   *                     for the largest feature index. As the scan reads the
+   *                     whole file, callers that create several readers for
+   *                     the same file should only do it once.
+   */
+  LetorReader(const std::string& file_name, size_t num_features=0);
 
   /** @p doc is not modified by this method, as it is not part of the data. */
   bool read_line(std::string& qid, std::string& doc, int& rel,
                  std::vector<double>& features);
 
-  inline size_t num_features() { return VECTOR_LENGTH; }
+  /** Returns the features as they are in the file, without densifying them. */
+  bool read_line_sparse(std::string& qid, std::string& doc, int& rel,
+                        std::vector<double>& features);
+
+  inline size_t num_features() { return vector_length; }
+
+  /** The format has no document ids. */
+  static const bool HAS_DOC_IDS = false;
 
-  /** The number of features. */
-  static size_t VECTOR_LENGTH;
 private:
-  /** Lines are read into this. */
-  std::string line;
-  /** Object for field separation. */
-  std::stringstream ss;
+  /**
+   * Returns the largest feature index in the file. As the format requires
+   * the indices to be increasing, only the last feature of each line is
+   * parsed.
+   */
+  size_t scan_num_features();
+
+  /** The number of features. */
+  size_t vector_length;
 };
 
 class YahooChallengeReader : public InputFileReader {
@@ -137,6 +227,9 @@ public:
 
   inline size_t num_features() { return vector_length; }
 
+  /** The format has no document ids. */
+  static const bool HAS_DOC_IDS = false;
+
 private:
   /** Reads the first line and sets vector_length. */
   bool read_first_line(std::string& qid, std::string& doc, int& rel,
@@ -144,9 +237,140 @@ private:
 
   /** The number of features. */
   size_t vector_length;
-  /** Lines are read into this. */
-  std::string line;
-  /** Object for field separation. */
-  std::stringstream ss;
 };
 
+/**
+ * Reads a binary dataset written by ltr_convert (see ml/binary_dataset.h).
+ * The file is mapped, not parsed: a row is gathered from the feature columns.
+ * The query ids are those assigned by the converter. Binned files have bin
+ * indices instead of feature values, and cannot be read.
+ */
+class BinaryDatasetReader : public InputFileReader {
+public:
+  BinaryDatasetReader(const std::string& file_name);
+
+  /** @p doc is not modified by this method, as it is not part of the data. */
+  bool read_line(std::string& qid, std::string& doc, int& rel,
+                 std::vector<double>& features);
+
+  inline size_t num_features() { return header.dimensions; }
+
+  /** The format has no document ids. */
+  static const bool HAS_DOC_IDS = false;
+
+  /** The rows are not lines: the file is always read sequentially. */
+  inline bool seekable() const { return false; }
+
+  /**
+   * Whether the file could be read: it is a valid binary dataset, with
+   * feature values of type @c feature_t.
+   */
+  inline bool valid() const { return data != NULL; }
+
+private:
+  BinaryDatasetHeader header;
+  /** The row read_line() will return next. */
+  uint64_t row;
+  /** The sections of the file; @c NULL if it is not valid(). */
+  const int32_t*   qids;
+  const double*    relevance;
+  const feature_t* data;
+};
+
+
+/** Creates a reader; read_rows() asks for one for each thread. */
+typedef std::function<InputFileReader*()> ReaderFactory;
+
+/** Receives the rows returned by a reader; see read_rows(). */
+typedef std::function<void(const std::string& qid, const std::string& doc,
+                           int rel, std::vector<double>& features)> RowHandler;
+
+/**
+ * Reads the file of the readers created by @p factory, and passes each row to
+ * @p handler in the order they appear in the file.
+ *
+ * If @p num_threads is greater than 1, the file is split into chunks of about
+ * @p chunk_size bytes whose boundaries coincide with query boundaries. The
+ * chunks are parsed in parallel (one reader per thread), and the rows are
+ * passed to @p handler (from the calling thread) chunk by chunk, so that the
+ * order of the calls is the same as in the serial case.
+ *
+ * If @p sparse is @c true, the features are read with
+ * InputFileReader::read_line_sparse().
+ *
+ * Files that are not InputFileReader::seekable() (e.g. compressed ones) are
+ * always read serially.
+ */
+void read_rows(const ReaderFactory& factory, const RowHandler& handler,
+               int num_threads=1, size_t chunk_size=64 << 20,
+               bool sparse=false);
+
+/**
+ * The rows of a query, as returned by QueryBlockReader. The features of all
+ * rows are stored in a single array: the features of row @c i are
+ * <tt>[row_begin(i), row_end(i))</tt>. In dense mode, all rows are (usually)
+ * of the same length, so @c features is a row-major
+ * <tt>size() x row_length(0)</tt> matrix; see uniform().
+ */
+struct QueryBlock {
+  /** The query id. */
+  std::string qid;
+  /** The document ids of the rows. */
+  std::vector<std::string> docs;
+  /** The relevance of the rows. */
+  std::vector<int> relevance;
+  /** The features of all rows, concatenated. */
+  std::vector<double> features;
+  /** The start of the features of each row in @c features, plus the end. */
+  std::vector<size_t> offsets;
+
+  QueryBlock();
+
+  /** Empties the block (but keeps the memory allocated). */
+  void clear();
+  /** Appends a row. */
+  void add_row(const std::string& doc, int rel,
+               const std::vector<double>& row);
+
+  /** The number of rows (documents). */
+  inline size_t size() const { return relevance.size(); }
+  inline const double* row_begin(size_t i) const {
+    return features.data() + offsets[i];
+  }
+  inline const double* row_end(size_t i) const {
+    return features.data() + offsets[i + 1];
+  }
+  inline size_t row_length(size_t i) const {
+    return offsets[i + 1] - offsets[i];
+  }
+  /** Whether all rows are of the same length, i.e. the block is a matrix. */
+  bool uniform() const;
+};
+
+/** Receives the query blocks read by QueryBlockReader. */
+typedef std::function<void(const QueryBlock& block)> BlockHandler;
+
+/**
+ * Groups the rows returned by read_rows() into query blocks: runs of
+ * consecutive rows with the same query id. This saves the consumers from
+ * having to group the rows themselves, and allows per-query computations
+ * while the block is still in the cache.
+ *
+ * Note that if the rows of a query are not contiguous in the file, the query
+ * is returned in several blocks.
+ */
+class QueryBlockReader {
+public:
+  /** See read_rows() for the parameters. */
+  QueryBlockReader(const ReaderFactory& factory, int num_threads=1,
+                   size_t chunk_size=64 << 20, bool sparse=false);
+
+  /** Reads the file and passes each block to @p handler, in file order. */
+  void read(const BlockHandler& handler);
+
+private:
+  ReaderFactory factory;
+  int num_threads;
+  size_t chunk_size;
+  bool sparse;
+};
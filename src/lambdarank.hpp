@@ -52,7 +52,9 @@ public:
 //      std::cout << "s[" << i << "] == " << s_is[i] << std::endl;
     }
     /* ...and the retrieval measure scores. */
-    opt.compute(query);
+    NdcgOptimizer opt;
+    opt.compute(query, scores,
+                query_table->idcg(query_table->find(query.id())));
 
 
     /* Now, we compute the errors (lambdas). */
@@ -74,15 +76,8 @@ public:
     /* Finally, the model update. */
     for (int i = 0; i < query.num_outedges(); i++) {
       // -lambdas[i], as C is a utility function in this case
-      umodel->update(query.outedge(i)->get_vector()->get_data(), s_is[i], lambdas[i]);
+      update_gradient(umodel, query.outedge(i), s_is[i], lambdas[i]);
     }
   }
-
-private:
-  /**
-   * The information retrieval measure we are optimizing for.
-   * @todo add more measures.
-   */
-  NdcgOptimizer opt;
 };
 
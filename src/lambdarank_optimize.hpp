@@ -35,36 +35,22 @@
 class NdcgOptimizer {
 public:
   /**
-   * Computes the score for the query. This version computes the idcg, as well
-   * as the document->rank map, as we need these to compute differences. It does
-   * NOT compute the nDCG itself.
+   * Computes the score for the query. This version computes the
+   * document->rank map, as we need it to compute differences. It does NOT
+   * compute the nDCG itself.
+   * @param[in] scores the scores of the edges.
+   * @param[in] idcg the ideal DCG of the query; see QueryTable::idcg().
    */
-  void compute(graphchi_vertex<TypeVertex, FeatureEdge>& v) {
-    // TODO: FeatureEdge* to make it faster?
-    std::vector<FeatureEdge*> ranked(v.num_outedges());
-    for (int i = 0; i < v.num_outedges(); i++) {
-      ranked[i] = v.outedge(i)->get_vector();
-    }
-    std::sort(ranked.begin(), ranked.end(), rel_comp);
-
-    double dcg = 0;
-    for (size_t i = 0; i < ranked.size(); i++) {
-//      std::cout << ranked[i].doc << "(" << ranked[i].relevance << "), ";
-      //DYN dcg += (pow(2, best[i]->get(best[i]->size() - 2)) - 1) /
-      dcg += (pow(2, ranked[i]->header().relevance) - 1) /
-             (log(i + 2) / log(2));
-    }
-//    std::cout << std::endl;
-
-    idcg = dcg;
+  void compute(graphchi_vertex<TypeVertex, FeatureEdge>& v,
+               const EdgeScores& scores, double idcg) {
+    this->idcg = idcg;
 //    std::cout << "iDCG == " << idcg << std::endl;
 
     /* Jeeebus, is there no better way? */
-    std::sort(ranked.begin(), ranked.end(), score_comp);
     rank_map.clear();
     std::map<double, int> ranking;
     for (int i = 0; i < v.num_outedges(); i++) {
-      ranking[-v.outedge(i)->get_vector()->header().score] = i;
+      ranking[-scores[v.outedge(i)->get_vector()->header().ordinal]] = i;
 //      std::cout << "ranking[" << -v.outedge(i)->get_data().score << "] = " << i << std::endl;
     }
     int rank = 0;
@@ -88,16 +74,6 @@ public:
     return ret / idcg;
   }
 
-  /** For inverse sorting by relevance. Needed to compute the iDCG. */
-  static bool rel_comp(const FeatureEdge* e1, const FeatureEdge* e2) {
-    return e1->header().relevance > e2->header().relevance;
-  }
-
-  /** For inverse sorting by score. Needed to build the rank map. */
-  static bool score_comp(const FeatureEdge* e1, const FeatureEdge* e2) {
-    return e1->header().score > e2->header().score;
-  }
-
 private:
   /**
    * Computes the contribution of document @p i in the ndcg score at rank
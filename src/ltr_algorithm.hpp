@@ -23,16 +23,20 @@
  * The LtrAlgorithm base class.
  */
 
+#include <algorithm>  // max
 #include <iostream>
 #include <iterator>  // ostream_iterator -- DEBUG only
 #include <iomanip>
 #include <map>
 #include <vector>
-#include <memory>    // auto_ptr
+#include <string>
 
 #include "ltr_common.hpp"
+#include "static_features.h"
+#include "query_table.h"
 //#include "util/pthread_tools.hpp"  // mutex
 #include "ml/ml_model.h"
+#include "ml/model_checkpoint.h"
 #include "evaluation_measures.hpp"
 #include "ml/linear_regression.h"  // TODO: remove
 
@@ -67,10 +71,11 @@ public:
    */
   LtrAlgorithm(DifferentiableModel* model, EvaluationMeasure* eval,
                StoppingCondition stop, LtrRunningPhase phase=TRAINING)
-      : model(model), eval(eval), stop(stop), phase(phase),
+      : model(model), scoring_model(NULL), eval(eval), stop(stop),
+        phase(phase), static_features(NULL), query_table(NULL), batch_size(0),
         last_eval_value(0)
   {
-    last_model.reset(NULL);
+    eval->set_scores(&scores);
   }
 
   ~LtrAlgorithm() {
@@ -82,6 +87,42 @@ public:
     }
   }
 
+  /**
+   * Sets the vertex ids of the queries of the dataset. If the engine has a
+   * scheduler, only these vertices are scheduled in each iteration, instead
+   * of visiting all documents as well; see save_query_vertices().
+   */
+  void schedule_queries(const std::vector<vid_t>& queries) {
+    query_vertices = queries;
+  }
+
+  /**
+   * Sets the static features of the current dataset, or @c NULL if it has
+   * none. The table must outlive the run.
+   */
+  void set_static_features(const StaticFeatureTable* table) {
+    static_features = table;
+  }
+
+  /**
+   * Sets the QueryTable of the current dataset, also for the evaluation
+   * measure. The table must outlive the run.
+   */
+  void set_query_table(const QueryTable* table) {
+    query_table = table;
+    eval->set_query_table(table);
+  }
+
+  /**
+   * Sets the model that scores the documents instead of @c model, e.g. one
+   * loaded by load_model(); @c NULL to score with @c model again. The model
+   * is not deleted by this object, and it is not trained: use it for
+   * validation and testing only.
+   */
+  void set_scoring_model(const MlModel* scoring_model) {
+    this->scoring_model = scoring_model;
+  }
+
   /**
    * Changes the phase -- if after learning, validation or testing is also
    * needed.
@@ -96,21 +137,46 @@ public:
    * Called after an iteration has finished. Aggregates the evaluation measure.
    * Also creates a number of copies of the ML model equal to the number of
    * execution threads, so that the model update can be parallel.
+   *
+   * In the first iteration, the score array is (re)created: there are fewer
+   * edges than vertices, so @c nvertices scores are enough. The array is
+   * backed by the file in the @c scores_file option, if specified.
+   *
+   * If the @c batch_size option is set, training is mini-batch: see update().
    */
   void before_iteration(int iteration, graphchi_context &ginfo) {
+    if (iteration == 0 &&
+        !scores.resize(ginfo.nvertices,
+                       get_option_string("scores_file", ""))) {
+      logstream(LOG_FATAL) << "Could not create the score array." << std::endl;
+    }
+    if (ginfo.scheduler != NULL && !query_vertices.empty()) {
+      ginfo.scheduler->remove_tasks(0, ginfo.nvertices - 1);
+      for (size_t i = 0; i < query_vertices.size(); i++) {
+        ginfo.scheduler->add_task(query_vertices[i], true);
+      }
+    }
     if (phase == TRAINING || phase == VALIDATION || phase == TESTING) {
       eval->before_iteration(iteration, ginfo);
     }
-    for (int i = 0; i < ginfo.execthreads; i++) {
-      if (iteration == 0) {
-        parallel_models.push_back(model->get_gradient_object());
-      } else {
-        parallel_models[i]->reset();
-      }
+    if (iteration == 0) {
+      full_rows.resize(ginfo.execthreads);
+      batch_size = get_option_int("batch_size", 0);
+      checkpoint_file = get_option_string("checkpoint_file", "");
+    }
+    batch_counts.assign(ginfo.execthreads, 0);
+    /*
+     * The gradient objects are created once, and are reset before each
+     * iteration, so that no gradient is left over from a previous run.
+     */
+    while (parallel_models.size() < static_cast<size_t>(ginfo.execthreads)) {
+      parallel_models.push_back(model->get_gradient_object());
+    }
+    for (size_t i = 0; i < parallel_models.size(); i++) {
+      parallel_models[i]->reset();
     }
-    /* We count the number of queries. */
     if (iteration == 0) {
-      num_queries = 0;
+      num_queries = query_table->size();
     }
 //    std::cout << std::setprecision(10);
 //    std::cout << "LINREG_UPDATE BEFORE ";
@@ -128,18 +194,28 @@ public:
   /**
    * This method runs only for the query nodes. Its actual function is divided
    * into several methods, as not all is needed in each phase.
+   *
+   * Only queries have out-edges, so the vertex data is not needed to tell
+   * them apart from the documents; this allows the engine to skip loading it.
+   * With schedule_queries(), the documents are not even visited.
+   *
+   * In mini-batch mode (the @c batch_size option), each execthread applies its
+   * gradients to the model after every @c batch_size queries it processes,
+   * without locking (see Gradient#apply()); otherwise, the model is only
+   * updated in after_iteration().
    */
   void update(graphchi_vertex<TypeVertex, FeatureEdge> &v,
               graphchi_context &ginfo) {
-    // TODO Use a scheduler instead of this?
-    if (v.get_data().type == QUERY) {  // Only queries have outedges (TODO: ???)
-      /* We count the number of queries. */
-      if (ginfo.iteration == 0) {
-        num_queries++;
-      }
+    if (v.num_outedges() > 0) {
       score_documents(v, ginfo);
       if (phase == TRAINING) {
-        compute_gradients(v, parallel_models[omp_get_thread_num()]);
+        int thread = omp_get_thread_num();
+        compute_gradients(v, parallel_models[thread]);
+        if (batch_size > 0 && ++batch_counts[thread] == batch_size) {
+          parallel_models[thread]->apply(batch_size);
+          parallel_models[thread]->reset();
+          batch_counts[thread] = 0;
+        }
       }
       if (phase == TRAINING || phase == VALIDATION || phase == TESTING) {
         evaluate_model(v, ginfo);
@@ -148,18 +224,16 @@ public:
   }
 
   /**
-   * Called after an iteration has finished. Aggregates the model updates and
-   * the evaluation measure.
+   * Called after an iteration has finished. Aggregates the model updates (in
+   * the training phase only) and the evaluation measure. In mini-batch mode,
+   * the gradients of the queries not yet applied form the last batch.
    */
   void after_iteration(int iteration, graphchi_context &ginfo) {
     // TODO: to separate class?
 
 //    std::cout << "LINREG_UPDATES:" << std::endl;
-    /* Add the delta. */
-    for (int i = 0; i < ginfo.execthreads; i++) {
-//      std::cout << "GRADIENT" << std::endl;
-//      std::cout << parallel_models[i]->str() << std::endl << std::endl;
-      parallel_models[i]->update_parent(num_queries);
+    if (phase == TRAINING) {
+      update_model(ginfo);
     }
 //    std::cout << "LINREG_UPDATE AFTER ";
 //    LinearRegression* lr_model = (LinearRegression*)model;
@@ -188,27 +262,60 @@ public:
     if (stop == STOP_TRAINING) {
       if (phase == TRAINING) {
         if (eval->avg_eval < last_eval_value) {
-          if (last_model.get() != NULL) {
-            model = last_model.release();
+          if (!best_model.empty()) {
+            best_model.restore(*model);
           }
           ginfo.set_last_iteration(ginfo.iteration);
         } else {
           last_eval_value = eval->avg_eval;
-          last_model.reset(model->clone());
+          best_model.snapshot(*model);
+          if (!checkpoint_file.empty()) {
+            best_model.save_async(*model, checkpoint_file);
+          }
         }
       }
     }
   }
 
 protected:
+  /**
+   * Adds the delta: sums the per-thread gradients pairwise in log(threads)
+   * parallel rounds, and updates the model (and the learning rate) once.
+   */
+  void update_model(graphchi_context &ginfo) {
+    int threads = static_cast<int>(parallel_models.size());
+    for (int step = 1; step < threads; step *= 2) {
+#pragma omp parallel for num_threads(ginfo.execthreads)
+      for (int i = 0; i < threads - step; i += 2 * step) {
+        parallel_models[i]->merge(*parallel_models[i + step]);
+      }
+    }
+//    std::cout << "GRADIENT" << std::endl;
+//    std::cout << parallel_models[0]->str() << std::endl << std::endl;
+    size_t num_items = num_queries;
+    if (batch_size > 0) {
+      num_items = 0;
+      for (size_t i = 0; i < batch_counts.size(); i++) {
+        num_items += batch_counts[i];
+      }
+      /* The queries of the last, partial batch; possibly none. */
+    }
+    parallel_models[0]->update_parent(num_items);
+  }
+
   /** Scores all documents for the query. The first step in update(). */
   void score_documents(graphchi_vertex<TypeVertex, FeatureEdge> &query,
                        graphchi_context &ginfo) {
     // XXX
 //    std::map<double, FeatureEdge> scores;
+    const MlModel* scorer = scoring_model != NULL ? scoring_model : model;
     for (int doc = 0; doc < query.num_outedges(); doc++) {
       FeatureEdge* fe = query.outedge(doc)->get_vector();
-      fe->header().score = model->score(fe->get_data());
+      size_t length;
+      feature_t* features = edge_features(fe, length);
+      scores[fe->header().ordinal] = fe->header().sparse
+          ? scorer->score_sparse(features, length / 2)
+          : scorer->score(features);
 //      query.outedge(doc)->set_vector(fe);
 
 //      scores[fe.score] = fe;
@@ -238,7 +345,42 @@ protected:
   inline double get_score(graphchi_edge<EdgeDataType>* edge) {
     //DYN FeatureEdge* i_vect = edge->get_vector();
     //DYN return i_vect->get(i_vect->size() - 1);
-    return edge->get_vector()->header().score;
+    return scores[edge->get_vector()->header().ordinal];
+  }
+
+  /**
+   * Updates the gradients in @p umodel with the features on @p edge, be they
+   * dense or sparse.
+   * @see Gradient#update()
+   */
+  inline void update_gradient(Gradient* umodel,
+                              graphchi_edge<EdgeDataType>* edge,
+                              double output, double mult) {
+    FeatureEdge* fe = edge->get_vector();
+    size_t length;
+    feature_t* features = edge_features(fe, length);
+    if (fe->header().sparse) {
+      umodel->update_sparse(features, length / 2, output, mult);
+    } else {
+      umodel->update(features, output, mult);
+    }
+  }
+
+  /**
+   * Returns the features on @p fe, followed by the static features of its
+   * document, if the dataset has any; see StaticFeatureTable::combine().
+   * @param[out] length the number of values.
+   */
+  inline feature_t* edge_features(FeatureEdge* fe, size_t& length) {
+    if (static_features == NULL) {
+      length = fe->size();
+      return fe->get_data();
+    }
+    std::vector<feature_t>& full = full_rows[omp_get_thread_num()];
+    static_features->combine(fe->get_data(), fe->size(), fe->header().sparse,
+                             fe->header().static_row, full);
+    length = full.size();
+    return full.data();
   }
 
   /** Returns the relevance of a query-document pair. */
@@ -251,8 +393,12 @@ protected:
 protected:
   /** The model that backs up RankNet. */
   DifferentiableModel* model;
+  /** Scores the documents instead of @c model; see set_scoring_model(). */
+  const MlModel* scoring_model;
   /** The evaluation measure. */
   EvaluationMeasure* eval;
+  /** The scores of the edges of the current dataset. */
+  EdgeScores scores;
   /** The stopping condition. */
   StoppingCondition stop;
   /** Which phase to run? */
@@ -264,8 +410,24 @@ protected:
    */
   std::vector<Gradient*> parallel_models;
 
+  /** The static features of the current dataset; see edge_features(). */
+  const StaticFeatureTable* static_features;
+  /** The full feature rows built by edge_features(), by execthread. */
+  std::vector<std::vector<feature_t> > full_rows;
+
+  /** The queries of the current dataset; see set_query_table(). */
+  const QueryTable* query_table;
   /** The total number of queries. */
   size_t num_queries;
+  /**
+   * The number of queries after which an execthread updates the model; 0
+   * means full-batch learning. Set by the @c batch_size option.
+   */
+  size_t batch_size;
+  /** The number of queries in the current mini-batch, by execthread. */
+  std::vector<size_t> batch_counts;
+  /** The vertex ids of the queries; see schedule_queries(). */
+  std::vector<vid_t> query_vertices;
 
   /**
    * The value of the evaluation measure in the last iteration. Used as a
@@ -274,9 +436,100 @@ protected:
    */
   double last_eval_value;
   /**
-   * Backup of the ML model from the last iteration. If we stop because the
-   * evaluation measure gets worse, we need to return the backed up model.
+   * Backup of the parameters of the ML model from the last iteration. If we
+   * stop because the evaluation measure gets worse, we need to return the
+   * backed up model.
+   */
+  ModelCheckpoint best_model;
+  /**
+   * If not empty, each backup is also written to this file, in the
+   * background, as a model file that load_model() can read. Set by the
+   * @c checkpoint_file option.
    */
-  std::auto_ptr<DifferentiableModel> last_model;
+  std::string checkpoint_file;
 };
 
+
+/**
+ * Checks that a validation run does not change the model: trains a linear
+ * regression pointwise for an iteration on two queries, in two execthreads,
+ * and then runs an iteration in the VALIDATION phase. The query table is
+ * written to @p file_name.
+ * @return whether the weights are unchanged by the validation run.
+ */
+inline bool test_validation_keeps_weights(const std::string& file_name) {
+  /** Regresses the scores to the relevance. */
+  class PointwiseAlgorithm : public LtrAlgorithm {
+  public:
+    PointwiseAlgorithm(DifferentiableModel* model)
+      : LtrAlgorithm(model, new NdcgEvaluator(10), DONT_STOP) {}
+
+    void compute_gradients(graphchi_vertex<TypeVertex, FeatureEdge> &query,
+                           Gradient* umodel) {
+      for (int doc = 0; doc < query.num_outedges(); doc++) {
+        graphchi_edge<FeatureEdge>* edge = query.outedge(doc);
+        double output = get_score(edge);
+        update_gradient(umodel, edge, output,
+                        get_relevance(edge) - output);
+      }
+    }
+  };
+
+  /* Two queries (vertices 0 and 4) of three documents each. */
+  const int QUERIES = 2;
+  const int DOCS = 3;
+  feature_t features[QUERIES][DOCS][2] = {
+    { { 1, 0 }, { 0.5, 1 }, { 0, 2 } },
+    { { 2, 1 }, { 1, 0.5 }, { 0, 0 } }
+  };
+  int relevance[QUERIES][DOCS] = { { 2, 1, 0 }, { 0, 1, 2 } };
+  QueryTableBuilder builder;
+  std::vector<uint32_t> query_vids;
+  std::vector<FeatureEdge> vectors(QUERIES * DOCS);
+  std::vector<graphchi_edge<FeatureEdge> > edges(QUERIES * DOCS);
+  for (int q = 0; q < QUERIES; q++) {
+    query_vids.push_back(q * (DOCS + 1));
+    for (int d = 0; d < DOCS; d++) {
+      int e = q * DOCS + d;
+      builder.add(q, relevance[q][d]);
+      vectors[e] = FeatureEdge(2, 2, EHeader(relevance[q][d], e, false, 0),
+                               features[q][d]);
+      edges[e] = graphchi_edge<FeatureEdge>(q * (DOCS + 1) + d + 1,
+                                            &vectors[e]);
+    }
+  }
+  QueryTable table;
+  if (!builder.save(file_name, query_vids) || !table.load(file_name)) {
+    return false;
+  }
+
+  LinearRegression* model = new LinearRegression(2);
+  PointwiseAlgorithm algorithm(model);
+  algorithm.set_query_table(&table);
+  graphchi_context ginfo;
+  ginfo.nvertices   = QUERIES * (DOCS + 1);
+  ginfo.execthreads = 2;
+  TypeVertex query_data(QUERY);
+  /* Runs an iteration; each query is processed by a different thread. */
+  auto run = [&]() {
+    algorithm.before_iteration(0, ginfo);
+#pragma omp parallel for num_threads(QUERIES) schedule(static, 1)
+    for (int q = 0; q < QUERIES; q++) {
+      graphchi_vertex<TypeVertex, FeatureEdge> vertex(
+          query_vids[q], NULL, &edges[q * DOCS], 0, DOCS);
+      vertex.set_data_ptr(&query_data);
+      algorithm.update(vertex, ginfo);
+    }
+    algorithm.after_iteration(0, ginfo);
+  };
+
+  run();
+  std::vector<double> trained(model->num_parameters());
+  model->snapshot_into(trained.data());
+  algorithm.set_phase(VALIDATION);
+  run();
+  std::vector<double> validated(model->num_parameters());
+  model->snapshot_into(validated.data());
+  algorithm.set_query_table(NULL);
+  return trained == validated;
+}
@@ -24,18 +24,13 @@
  */
 #define DYNAMICEDATA 1
 
-#ifndef DOC_ID_LENGTH
-#define DOC_ID_LENGTH 10
-#endif
-
 //#include <limits>
 
-#include <cstdio>
-
 #include "graphchi_basic_includes.hpp"
 #include "api/dynamicdata/chivector.hpp"
 
-#include "object.h"
+#include "edge_scores.h"
+#include "ml/feature.h"
 
 using namespace graphchi;
 
@@ -43,39 +38,57 @@ using namespace graphchi;
 typedef enum { QUERY, DOCUMENT } VertexType;
 
 /**
- * Vertex type that stores the type of the node (query or document) and the
- * real ID.
+ * Vertex type that stores the type of the node (query or document). The real
+ * (query or document) ids are not kept.
  */
 struct TypeVertex {
-  /** The (query or document) id. */
-  char       id[DOC_ID_LENGTH];
   /** The vertex type. */
   VertexType type;
 
-  TypeVertex(const char* id, VertexType type) : type(type) {
-    snprintf(this->id, DOC_ID_LENGTH, "%s", id);
-  }
-
-  TypeVertex(size_t id, VertexType type) : type(type) {
-    snprintf(this->id, DOC_ID_LENGTH, "%zu", id);
-  }
+  TypeVertex(VertexType type) : type(type) {}
 
   /** Default, do not use. */
   TypeVertex() {}
 };
 
-/** Header for the edges: stores relevance and score. */
-struct EHeader : public Object {
-  int relevance;
-  vid_t doc;    // DEBUG only
-  double score;
-  
+/**
+ * Header for the edges: stores the relevance and the edge ordinal. The score
+ * is not stored on the edge, but in an EdgeScores array, so that the shards
+ * are never modified.
+ */
+struct EHeader {
+  /** The index of the edge in the EdgeScores array. */
+  uint32_t ordinal;
+  /**
+   * The row of the document in the StaticFeatureTable of the dataset, if it
+   * has one.
+   */
+  uint32_t static_row;
+  int16_t relevance;
+  /**
+   * Whether the features are stored in sparse form, as (index, value) pairs;
+   * see MlModel#score_sparse().
+   */
+  bool sparse;
+
   EHeader() {}
-  EHeader(int relevance_, vid_t doc_, double score_=0)
-    : relevance(relevance_), doc(doc_), score(score_) {}
+  EHeader(int relevance_, uint32_t ordinal_, bool sparse_=false,
+          uint32_t static_row_=0)
+    : ordinal(ordinal_), static_row(static_row_),
+      relevance(static_cast<int16_t>(relevance_)), sparse(sparse_) {}
 };
 
-typedef chivector<double, EHeader> FeatureEdge;
+typedef chivector<feature_t, EHeader> FeatureEdge;
+
+/** Orders the edges by decreasing score. */
+struct ScoreComp {
+  const EdgeScores* scores;
+
+  ScoreComp(const EdgeScores* scores) : scores(scores) {}
+  inline bool operator()(const FeatureEdge* e1, const FeatureEdge* e2) const {
+    return (*scores)[e1->header().ordinal] > (*scores)[e2->header().ordinal];
+  }
+};
 
 ///**
 // * The edge data type. A chivector that stores the features, the relevance
@@ -0,0 +1,215 @@
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Converts a text dataset (csv, letor or yahoo) into the binary columnar
+ * format described in ml/binary_dataset.h, which can then be loaded with
+ * MmapDataContainer without parsing. ltr_main recognizes such files by their
+ * magic: LambdaMART learns them in place, and the other algorithms shard them
+ * with BinaryDatasetReader.
+ *
+ * If @c max_bins is specified, the features are quantized into at most that
+ * many bins (see FeatureQuantizer), and the bin indices are written instead
+ * of the values; such files are loaded with BinnedFeatures, and can only be
+ * used to train LambdaMART.
+ *
+ * Usage: ltr_convert <reader> <input file> <output file> [threads] [max_bins]
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "input_readers.h"
+#include "ml/binary_dataset.h"
+#include "ml/feature_quantizer.h"
+
+namespace {
+
+/** Returns a factory for readers of type @p reader; empty if unknown. */
+ReaderFactory get_reader_factory(const std::string& reader,
+                                 const std::string& file_name) {
+  if (reader == "csv") {
+    return [file_name]() -> InputFileReader* {
+      return new CsvReader(file_name);
+    };
+  } else if (reader == "letor") {
+    /* Pre-scan the file only once, not in every thread. */
+    size_t num_features = LetorReader(file_name).num_features();
+    return [file_name, num_features]() -> InputFileReader* {
+      return new LetorReader(file_name, num_features);
+    };
+  } else if (reader == "yahoo") {
+    return [file_name]() -> InputFileReader* {
+      return new YahooChallengeReader(file_name);
+    };
+  } else {
+    return ReaderFactory();
+  }
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+  if (argc < 4) {
+    std::cerr << "Usage: " << argv[0]
+              << " <csv|letor|yahoo> <input file> <output file> [threads]"
+              << " [max_bins]"
+              << std::endl;
+    return 1;
+  }
+  std::string reader      = argv[1];
+  std::string input_file  = argv[2];
+  std::string output_file = argv[3];
+  int threads             = argc > 4 ? atoi(argv[4]) : 1;
+  size_t max_bins         = argc > 5 ? strtoul(argv[5], NULL, 10) : 0;
+
+  ReaderFactory factory = get_reader_factory(reader, input_file);
+  if (!factory) {
+    std::cerr << "Reader " << reader << " is not implemented. "
+              << "Select one of csv, letor, yahoo." << std::endl;
+    return 1;
+  }
+
+  /*
+   * First pass: count the rows, the queries and the features, and sample the
+   * feature values for the quantizer.
+   */
+  FeatureQuantizer quantizer;
+  uint64_t rows        = 0;
+  uint64_t num_queries = 0;
+  size_t dimensions    = 0;
+  std::string last_qid;
+  read_rows(factory, [&](const std::string& qid, const std::string& doc,
+                         int rel, std::vector<double>& features) {
+    if (rows++ == 0 || qid != last_qid) {
+      num_queries++;
+      last_qid = qid;
+    }
+    if (features.size() > dimensions) dimensions = features.size();
+    if (max_bins > 0) quantizer.add_row(features.data(), features.size());
+  }, threads);
+
+  /* Create the output file and map it into memory. */
+  BinaryDatasetHeader header(rows, dimensions, num_queries);
+  /* The bin of 0 for each feature, for the features missing from a row. */
+  std::vector<uint16_t> zero_bins;
+  if (max_bins > 0) {
+    quantizer.finalize(max_bins);
+    header = BinaryDatasetHeader(rows, dimensions, num_queries,
+                                 quantizer.bin_size(),
+                                 quantizer.boundaries().size());
+    for (size_t f = 0; f < dimensions; f++) {
+      zero_bins.push_back(quantizer.bin(f, 0.0));
+    }
+  }
+  int fd = open(output_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || ftruncate(fd, header.file_size) != 0) {
+    perror("Cannot create output file");
+    return 1;
+  }
+  void* addr = mmap(NULL, header.file_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    perror("mmap failed");
+    return 1;
+  }
+  char* base = static_cast<char*>(addr);
+  memcpy(base, &header, sizeof(header));
+  uint64_t* query_offsets = reinterpret_cast<uint64_t*>(
+      base + header.query_offsets_pos);
+  int32_t* qids = reinterpret_cast<int32_t*>(base + header.qids_pos);
+  double* relevance = reinterpret_cast<double*>(base + header.relevance_pos);
+  feature_t* data = reinterpret_cast<feature_t*>(base + header.features_pos);
+  uint8_t* bins8   = reinterpret_cast<uint8_t*>(base + header.features_pos);
+  uint16_t* bins16 = reinterpret_cast<uint16_t*>(base + header.features_pos);
+  if (header.binned()) {
+    /* The boundary table. */
+    uint64_t* offsets = reinterpret_cast<uint64_t*>(
+        base + header.boundaries_pos);
+    std::copy(quantizer.offsets().begin(), quantizer.offsets().end(),
+              offsets);
+    /* Features never seen (shorter rows) have no boundaries. */
+    std::fill(offsets + quantizer.offsets().size(), offsets + dimensions + 1,
+              quantizer.offsets().back());
+    std::copy(quantizer.boundaries().begin(), quantizer.boundaries().end(),
+              reinterpret_cast<double*>(offsets + dimensions + 1));
+  }
+
+  /*
+   * Second pass: fill the sections. Features missing from a row are 0: the
+   * file is zeroed by ftruncate(), but in a binned file, they are set to the
+   * bin of 0, which is not necessarily bin 0.
+   */
+  std::map<std::string, int32_t> qid_ids;
+  uint64_t row   = 0;
+  uint64_t query = 0;
+  read_rows(factory, [&](const std::string& qid, const std::string& doc,
+                         int rel, std::vector<double>& features) {
+    if (row == 0 || qid != last_qid) {
+      query_offsets[query++] = row;
+      last_qid = qid;
+    }
+    std::map<std::string, int32_t>::iterator it = qid_ids.find(qid);
+    if (it == qid_ids.end()) {
+      it = qid_ids.insert(std::make_pair(qid, int32_t(qid_ids.size()))).first;
+    }
+    qids[row] = it->second;
+    relevance[row] = rel;
+    if (!header.binned()) {
+      for (size_t f = 0; f < features.size(); f++) {
+        data[f * rows + row] = static_cast<feature_t>(features[f]);
+      }
+    } else if (header.scalar_size == 1) {
+      for (size_t f = 0; f < dimensions; f++) {
+        bins8[f * rows + row] = static_cast<uint8_t>(
+            f < features.size() ? quantizer.bin(f, features[f])
+                                : zero_bins[f]);
+      }
+    } else {
+      for (size_t f = 0; f < dimensions; f++) {
+        bins16[f * rows + row] = f < features.size()
+                                     ? quantizer.bin(f, features[f])
+                                     : zero_bins[f];
+      }
+    }
+    row++;
+  }, threads);
+  query_offsets[num_queries] = rows;
+
+  munmap(addr, header.file_size);
+  close(fd);
+
+  std::cout << "Converted " << rows << " rows (" << num_queries << " queries, "
+            << dimensions << " features) to " << output_file;
+  if (header.binned()) {
+    std::cout << " (" << quantizer.max_num_bins() << " bins at most)";
+  }
+  std::cout << "." << std::endl;
+  return 0;
+}
@@ -23,6 +23,9 @@
  * specify what input dataset he wants to use and what algorithm, and the
  * control is then forwarded to the selected algorithm.
  */
+#include <memory>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 
 #include "ltr_common.hpp"
@@ -31,32 +34,84 @@
 #include "ranknet_lambda.hpp"
 #include "lambdarank.hpp"
 #include "evaluation_measures.hpp"
+#include "query_block_engine.hpp"
+#include "shard_loader.hpp"
+#include "ml/binary_dataset.h"
+#include "ml/data_container.h"
+#include "ml/feature_quantizer.h"
 #include "ml/learning_rate.h"
 #include "ml/linear_regression.h"
+#include "ml/mart.h"
+#include "ml/model_file.h"
 #include "ml/neural_net.h"
 #include "ml/regression_tree.h"
 
 using namespace graphchi;
 
 /**
- * Reads a dataset.
+ * Parses and shards a dataset.
  * @return the number of shards.
  */
-int read_data(std::string file_name, std::string file_type, size_t& dimensions) {
-  if (file_type == "csv") {
+int parse_data(std::string file_name, std::string file_type, size_t& dimensions,
+               const IngestOptions& ingest) {
+  if (file_type == "binary") {
+    return read_binary(file_name, dimensions, ingest);
+  } else if (file_type == "csv") {
     int qid_index = get_option_int("qid", 0);
     int doc_index = get_option_int("doc", 1);
     int rel_index = get_option_int("rel", -1);
-    return read_csv(file_name, dimensions, qid_index, doc_index, rel_index);
+    return read_csv(file_name, dimensions, qid_index, doc_index, rel_index,
+                    true, ingest);
   } else if (file_type == "letor") {
-    return read_letor(file_name, dimensions);
+    return read_letor(file_name, dimensions, ingest);
   } else if (file_type == "yahoo") {
-    return read_yahoo_ltr(file_name, dimensions);
+    return read_yahoo_ltr(file_name, dimensions, ingest);
   } else {
     return 0;
   } 
 }
 
+/**
+ * Reads a dataset: parses and shards it, unless it has already been sharded
+ * with the same options by a previous run; see read_cached(). Binary datasets
+ * written by ltr_convert are recognized by their magic, whatever the reader.
+ * @param[in] ingest the filters; see IngestOptions.
+ * @return the number of shards, or @c QUERY_BLOCKS_ONLY.
+ */
+int read_data(std::string file_name, std::string file_type, size_t& dimensions,
+              const IngestOptions& ingest=IngestOptions()) {
+  if (is_binary_dataset(file_name)) {
+    file_type = "binary";
+  }
+  std::ostringstream options;
+  options << file_type << " sparse=" << get_option_int("sparse", 0);
+  if (file_type == "csv") {
+    options << " qid=" << get_option_int("qid", 0)
+            << " doc=" << get_option_int("doc", 1)
+            << " rel=" << get_option_int("rel", -1);
+  } else if (file_type != "letor" && file_type != "yahoo" &&
+             file_type != "binary") {
+    return 0;
+  }
+  options << " static_features=" << get_option_string("static_features", "")
+          << " drop_queries=" << ingest.drop_constant_queries
+          << " drop_features=" << ingest.drop_constant_features;
+  if (!ingest.feature_map_of.empty()) {
+    options << " feature_map=" << std::hex
+            << hash_file(FeatureMap::map_name(ingest.feature_map_of))
+            << std::dec;
+  }
+  /* The blocks engine may skip sharding; see read_inner(). */
+  if (get_option_string("engine", "graphchi") == "blocks") {
+    options << " engine=blocks block_compression="
+            << get_option_string("block_compression", "none");
+  }
+  return read_cached(file_name, options.str(), dimensions,
+                     [&](size_t& dims) {
+                       return parse_data(file_name, file_type, dims, ingest);
+                     });
+}
+
 /** Instantiates the selected algorithm. */
 LtrAlgorithm* get_algorithm(std::string name, DifferentiableModel* model,
                             EvaluationMeasure* eval, StoppingCondition stop) {
@@ -99,6 +154,128 @@ EvaluationMeasure* get_evaluation_measure(std::string name, int cutoff) {
   }
 }
 
+/**
+ * The hash of the feature layout of dataset @p file_name, read with
+ * @p ingest: the FeatureMap that dropped the constant features, and the
+ * features moved to the StaticFeatureTable; see MlModel#set_feature_layout().
+ */
+uint64_t feature_layout(const std::string& file_name,
+                        const IngestOptions& ingest) {
+  std::ostringstream layout;
+  std::string map_of = ingest.drop_constant_features ? file_name
+                                                     : ingest.feature_map_of;
+  if (!map_of.empty()) {
+    layout << "feature_map=" << std::hex
+           << hash_file(FeatureMap::map_name(map_of)) << std::dec;
+  }
+  struct stat st;
+  if (stat(StaticFeatureTable::table_name(file_name).c_str(), &st) == 0) {
+    layout << " static_features=";
+    for (size_t i = 0; i < ingest.static_features.size(); i++) {
+      layout << (i > 0 ? "," : "") << ingest.static_features[i];
+    }
+  }
+  return hash_string(layout.str());
+}
+
+/**
+ * Checks that the documents of @p file_name, which have @p dimensions
+ * features, can be scored by @p model: that there are enough of them, and
+ * that they are laid out as in the training data.
+ */
+void check_dimensions(const MlModel* model, size_t dimensions,
+                      const std::string& file_name,
+                      const IngestOptions& ingest) {
+  if (model == NULL) {
+    return;
+  }
+  if (dimensions < model->get_dimensions()) {
+    logstream(LOG_FATAL) << file_name << " has " << dimensions << " features, "
+                         << "but the model expects " << model->get_dimensions()
+                         << "." << std::endl;
+  }
+  if (model->get_feature_layout() != 0 &&
+      model->get_feature_layout() != feature_layout(file_name, ingest)) {
+    logstream(LOG_FATAL) << "The features of " << file_name << " are not laid "
+                         << "out as those of the training data of the model; "
+                         << "check the drop_constant_features, train_data and "
+                         << "static_features options." << std::endl;
+  }
+}
+
+/**
+ * Trains @p mart for @p niters iterations on the binary dataset @p file_name,
+ * which is mapped into memory (see MmapDataContainer) instead of being
+ * sharded. The trees of a binned dataset are built on its bins (see
+ * BinnedFeatures). The filters in @p ingest only apply to sharded data.
+ */
+void learn_mapped(MART& mart, const std::string& file_name,
+                  const IngestOptions& ingest, int niters) {
+  if (ingest.drop_constant_queries || ingest.drop_constant_features ||
+      !ingest.static_features.empty()) {
+    logstream(LOG_WARNING) << "The ingest filters are not applied to "
+                           << file_name << ", which is learned in place."
+                           << std::endl;
+  }
+  BinaryDatasetHeader header;
+  bool binned = header.read(file_name) && header.binned();
+  std::unique_ptr<MmapDataContainer> data;
+  std::unique_ptr<BinnedFeatures> bins;
+  try {
+    if (binned) {
+      bins.reset(new BinnedFeatures(file_name));
+    } else {
+      data.reset(new MmapDataContainer(file_name));
+    }
+  } catch (const std::runtime_error& e) {
+    logstream(LOG_FATAL) << e.what() << std::endl;
+  }
+  mart.set_feature_layout(feature_layout(file_name, IngestOptions()));
+  if (binned) {
+    mart.learn(*bins, niters);
+  } else {
+    mart.learn(*data, niters);
+  }
+}
+
+/**
+ * Runs @p algorithm on a dataset. The engine is selected by the @c engine
+ * option: @c graphchi (the default) runs it on the shards, @c blocks on the
+ * query block store (see QueryBlockEngine).
+ */
+void run_algorithm(LtrAlgorithm& algorithm, const std::string& file_name,
+                   int nshards, int niters, const std::string& metrics_name) {
+  StaticFeatureTable static_features;
+  algorithm.set_static_features(static_features.load(file_name)
+                                    ? &static_features : NULL);
+  QueryTable query_table;
+  if (!query_table.load(file_name)) {
+    logstream(LOG_FATAL) << "Cannot load the query table of " << file_name
+                         << std::endl;
+  }
+  algorithm.set_query_table(&query_table);
+  if (get_option_string("engine", "graphchi") == "blocks") {
+    QueryBlockEngine engine(file_name, nshards);
+    engine.run(algorithm, niters);
+  } else {
+    /* Only the query vertices are scheduled, if we know which ones they are. */
+    std::vector<vid_t> queries;
+    bool scheduler = load_query_vertices(file_name, queries);
+    algorithm.schedule_queries(queries);
+    metrics m(metrics_name);
+    graphchi_engine<TypeVertex, FeatureEdge> engine(
+        file_name, nshards, scheduler, m);
+    engine.set_disable_vertexdata_storage();
+    /* The scores are kept in an EdgeScores array: the shards are read-only. */
+    engine.set_modifies_inedges(false);
+    engine.set_modifies_outedges(false);
+    engine.run(algorithm, niters);
+    metrics_report(m);
+  }
+  algorithm.set_static_features(NULL);
+  algorithm.set_query_table(NULL);
+}
+
 int main(int argc, const char ** argv) {
 //  print_copyright();
 //  NeuralNetwork(50, 20);
@@ -108,14 +285,13 @@ int main(int argc, const char ** argv) {
   graphchi_init(argc, argv);
 
   /* Parameters */
-  std::string train_data = get_option_string("train_data");  // TODO: not needed (save/load model)
+  std::string train_data = get_option_string("train_data", "");
   std::string eval_data = get_option_string("eval_data", "");
   std::string test_data = get_option_string("test_data", "");
   int niters            = get_option_int("niters", 10);
   int cutoff            = get_option_int("cutoff", 20);
   // TODO: make it overridable by --D?
   size_t dimensions     = 0;
-  bool scheduler        = false;  // No scheduler is needed
   std::string reader       = get_option_string("reader");
   std::string error_metric = get_option_string("error", "ndcg");
   std::string model_name     = get_option_string("mlmodel", "linreg");
@@ -123,15 +299,81 @@ int main(int argc, const char ** argv) {
   std::string learning_rate  = get_option_string("learning_rate", "");
   StoppingCondition stopping_condition =
       static_cast<StoppingCondition>(get_option_int("stopping_condition", 0));
+  /* The binary model files; see ml/model_file.h. */
+  std::string save_model_file = get_option_string("save_model", "");
+  std::string load_model_file = get_option_string("load_model", "");
+  if (train_data == "" && load_model_file == "") {
+    logstream(LOG_FATAL) << "Either train_data or load_model must be "
+                         << "specified." << std::endl;
+  }
 
-  /* Read the data file. */
-  int train_nshards = read_data(train_data, reader, dimensions);
-  if (train_nshards == 0) {
-    logstream(LOG_FATAL) << "Reader " << reader << " is not implemented. " <<
-                            "Select one of csv, letor." << std::endl;
+  /*
+   * The filters: the queries without document pairs are only dropped from the
+   * training set, but the features dropped from it are dropped from all sets.
+   */
+  IngestOptions train_ingest;
+  train_ingest.drop_constant_queries =
+      get_option_int("drop_constant_queries", 0) != 0;
+  train_ingest.drop_constant_features =
+      get_option_int("drop_constant_features", 0) != 0;
+  train_ingest.static_features =
+      parse_feature_list(get_option_string("static_features", ""));
+  IngestOptions test_ingest;
+  if (train_ingest.drop_constant_features) {
+    test_ingest.feature_map_of = train_data;
+  }
+  test_ingest.static_features = train_ingest.static_features;
+
+  /*
+   * A loaded model is not trained, only validated and tested: it scores the
+   * documents instead of the model of the algorithm.
+   */
+  std::unique_ptr<MlModel> loaded_model;
+  int train_nshards = 0;
+  /* LambdaMART learns binary datasets in place, without sharding them. */
+  bool mapped_train = load_model_file == "" &&
+                      algorithm_name == "lambdamart" &&
+                      is_binary_dataset(train_data);
+  if (load_model_file != "") {
+    loaded_model.reset(load_model(load_model_file));
+    if (loaded_model.get() == NULL) {
+      logstream(LOG_FATAL) << "Cannot load the model from " << load_model_file
+                           << "." << std::endl;
+    }
+    dimensions = loaded_model->get_dimensions();
+    /* The loaded trees are evaluated by the generic algorithm. */
+    if (algorithm_name == "lambdamart") {
+      algorithm_name = "ranknet";
+    }
+  } else if (!mapped_train) {
+    /* Read the data file. */
+    train_nshards = read_data(train_data, reader, dimensions, train_ingest);
+    if (train_nshards == 0) {
+      logstream(LOG_FATAL) << "Reader " << reader << " is not implemented. " <<
+                              "Select one of csv, letor." << std::endl;
+    }
   }
 
   LearningRate* lr_obj = create_learning_rate_function(learning_rate);
+
+  /* LambdaMART learns in memory, from the rows loaded from the shards. */
+  if (algorithm_name == "lambdamart") {
+    MART mart(lr_obj, get_option_int("max_bins", 0));
+    if (mapped_train) {
+      learn_mapped(mart, train_data, train_ingest, niters);
+    } else {
+      InputDataContainer data(dimensions);
+      load_shards(train_data, train_nshards, data);
+      mart.set_feature_layout(feature_layout(train_data, train_ingest));
+      mart.learn(data, niters);
+    }
+    if (save_model_file != "" && !mart.save(save_model_file)) {
+      logstream(LOG_ERROR) << "Cannot save the model to " << save_model_file
+                           << "." << std::endl;
+    }
+    return 0;
+  }
+
   /* Instantiate the algorithm. */
   DifferentiableModel* model = get_ml_model(model_name, dimensions, lr_obj);
   if (model == NULL) {
@@ -156,48 +398,42 @@ int main(int argc, const char ** argv) {
     exit(1);
   }
 
-  /* Training. */
-  metrics m_train("ltr_train");
-  graphchi_engine<TypeVertex, FeatureEdge> engine(
-      train_data, train_nshards, scheduler, m_train); 
-  engine.run(*algorithm, niters);
-  metrics_report(m_train);
+  if (loaded_model.get() != NULL) {
+    algorithm->set_scoring_model(loaded_model.get());
+  } else {
+    /* Training. */
+    model->set_feature_layout(feature_layout(train_data, train_ingest));
+    run_algorithm(*algorithm, train_data, train_nshards, niters, "ltr_train");
+    if (save_model_file != "" && !model->save(save_model_file)) {
+      logstream(LOG_ERROR) << "Cannot save the model to " << save_model_file
+                           << "." << std::endl;
+    }
+  }
 
   /* Validation. */
   if (eval_data != "") {
-    int eval_nshards = read_data(eval_data, reader, dimensions);
+    int eval_nshards = read_data(eval_data, reader, dimensions, test_ingest);
     if (eval_nshards == 0) {
       logstream(LOG_FATAL) << "Reader " << reader << " is not implemented. " <<
                               "Select one of csv, letor." << std::endl;
     }
+    check_dimensions(loaded_model.get(), dimensions, eval_data, test_ingest);
     algorithm->set_phase(VALIDATION);
-    metrics m_eval("ltr_eval");
-    graphchi_engine<TypeVertex, FeatureEdge> engine(
-        eval_data, eval_nshards, scheduler, m_eval); 
-    engine.run(*algorithm, niters);
-    metrics_report(m_eval);
+    run_algorithm(*algorithm, eval_data, eval_nshards, niters, "ltr_eval");
   }
 
   /* Testing. */
   if (test_data != "") {
-    int test_nshards = read_data(test_data, reader, dimensions);
+    int test_nshards = read_data(test_data, reader, dimensions, test_ingest);
     if (test_nshards == 0) {
       logstream(LOG_FATAL) << "Reader " << reader << " is not implemented. " <<
                               "Select one of csv, letor." << std::endl;
     }
+    check_dimensions(loaded_model.get(), dimensions, test_data, test_ingest);
     algorithm->set_phase(TESTING);
-    metrics m_test("ltr_test");
-    graphchi_engine<TypeVertex, FeatureEdge> engine(
-        test_data, test_nshards, scheduler, m_test); 
-    engine.run(*algorithm, niters);
-    metrics_report(m_test);
+    run_algorithm(*algorithm, test_data, test_nshards, niters, "ltr_test");
   }
 
   return 0;
 }
 
-/*
- * Problems:
- * - MlModel: must have a save/load function
- */
-
@@ -0,0 +1,78 @@
+#include "ml/binary_dataset.h"
+
+#include <cstdio>
+#include <cstring>
+
+const char BINARY_DATASET_MAGIC[8] = { 'L', 'T', 'R', 'B', 'I', 'N', 0, 0 };
+
+namespace {
+/** Rounds @p pos up to the next multiple of BINARY_DATASET_ALIGNMENT. */
+inline uint64_t align(uint64_t pos) {
+  return (pos + BINARY_DATASET_ALIGNMENT - 1) /
+         BINARY_DATASET_ALIGNMENT * BINARY_DATASET_ALIGNMENT;
+}
+}
+
+BinaryDatasetHeader::BinaryDatasetHeader() {
+  memset(this, 0, sizeof(BinaryDatasetHeader));
+}
+
+BinaryDatasetHeader::BinaryDatasetHeader(uint64_t rows_, uint64_t dimensions_,
+                                         uint64_t num_queries_,
+                                         uint32_t scalar_size_,
+                                         uint64_t num_boundaries_) {
+  memset(this, 0, sizeof(BinaryDatasetHeader));
+  memcpy(magic, BINARY_DATASET_MAGIC, sizeof(magic));
+  version           = BINARY_DATASET_VERSION;
+  scalar_size       = scalar_size_;
+  rows              = rows_;
+  dimensions        = dimensions_;
+  num_queries       = num_queries_;
+  query_offsets_pos = align(sizeof(BinaryDatasetHeader));
+  qids_pos          = align(query_offsets_pos +
+                            (num_queries + 1) * sizeof(uint64_t));
+  relevance_pos     = align(qids_pos + rows * sizeof(int32_t));
+  features_pos      = align(relevance_pos + rows * sizeof(double));
+  boundaries_pos    = align(features_pos + rows * dimensions * scalar_size);
+  num_boundaries    = num_boundaries_;
+  file_size         = boundaries_pos;
+  if (binned()) {
+    file_size += (dimensions + 1) * sizeof(uint64_t) +
+                 num_boundaries * sizeof(double);
+  }
+}
+
+bool BinaryDatasetHeader::valid(uint64_t actual_file_size) const {
+  BinaryDatasetHeader expected(rows, dimensions, num_queries, scalar_size,
+                               num_boundaries);
+  return memcmp(magic, BINARY_DATASET_MAGIC, sizeof(magic)) == 0 &&
+         version == BINARY_DATASET_VERSION &&
+         (scalar_size == 1 || scalar_size == 2 ||
+          scalar_size == sizeof(float) || scalar_size == sizeof(double)) &&
+         query_offsets_pos == expected.query_offsets_pos &&
+         qids_pos == expected.qids_pos &&
+         relevance_pos == expected.relevance_pos &&
+         features_pos == expected.features_pos &&
+         boundaries_pos == expected.boundaries_pos &&
+         file_size == expected.file_size &&
+         file_size <= actual_file_size;
+}
+
+bool BinaryDatasetHeader::read(const std::string& file_name) {
+  FILE* f = fopen(file_name.c_str(), "rb");
+  if (f == NULL) return false;
+  bool ok = fread(this, sizeof(BinaryDatasetHeader), 1, f) == 1 &&
+            memcmp(magic, BINARY_DATASET_MAGIC, sizeof(magic)) == 0;
+  fclose(f);
+  return ok;
+}
+
+bool is_binary_dataset(const std::string& file_name) {
+  FILE* f = fopen(file_name.c_str(), "rb");
+  if (f == NULL) return false;
+  char magic[sizeof(BINARY_DATASET_MAGIC)];
+  bool ok = fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+            memcmp(magic, BINARY_DATASET_MAGIC, sizeof(magic)) == 0;
+  fclose(f);
+  return ok;
+}
@@ -0,0 +1,120 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * The binary columnar dataset format written by ltr_convert and read by
+ * MmapDataContainer. The file consists of a header and four sections, each
+ * aligned to @c BINARY_DATASET_ALIGNMENT bytes (five if the features are
+ * binned):
+ *
+ * 1. the query offset table: <tt>num_queries + 1</tt> @c uint64_t row indices;
+ *    the rows of query @c i are <tt>[offsets[i], offsets[i + 1])</tt>;
+ * 2. the query ids of the rows: @c rows @c int32_t values;
+ * 3. the relevance array: @c rows @c doubles;
+ * 4. the features: @c dimensions blocks of @c rows @c feature_t values, i.e.
+ *    a column-major <tt>rows x dimensions</tt> matrix, as in @c FeatureArray.
+ *    The size of @c feature_t is recorded in the header, so a file written
+ *    by a @c float build is rejected by a @c double build and vice versa.
+ *    In a binned file (see FeatureQuantizer), the features are @c uint8_t or
+ *    @c uint16_t bin indices instead;
+ * 5. binned files only: the bin boundary table; <tt>dimensions + 1</tt>
+ *    @c uint64_t offsets followed by @c num_boundaries @c doubles. The
+ *    boundaries of feature @c f are <tt>[offsets[f], offsets[f + 1])</tt>.
+ */
+
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+#include "ml/feature.h"
+
+/** The first bytes of a binary dataset file. */
+extern const char BINARY_DATASET_MAGIC[8];
+/** The current version of the format. */
+const uint32_t BINARY_DATASET_VERSION = 2;
+/** The alignment of the sections in the file. */
+const uint64_t BINARY_DATASET_ALIGNMENT = 64;
+
+/** The header of a binary dataset file. */
+struct BinaryDatasetHeader {
+  char     magic[8];
+  uint32_t version;
+  /**
+   * The size of a feature value: @c sizeof(feature_t), or the size of a bin
+   * index (1 or 2) in binned files.
+   */
+  uint32_t scalar_size;
+  /** The number of rows (query-document pairs). */
+  uint64_t rows;
+  /** The number of features. */
+  uint64_t dimensions;
+  /**
+   * The number of queries; more precisely, the number of runs of rows with
+   * the same query id.
+   */
+  uint64_t num_queries;
+  /** The offsets of the sections in the file. */
+  uint64_t query_offsets_pos;
+  uint64_t qids_pos;
+  uint64_t relevance_pos;
+  uint64_t features_pos;
+  uint64_t boundaries_pos;
+  /** The number of bin boundaries; 0 if the file is not binned. */
+  uint64_t num_boundaries;
+  /** The size of the whole file. */
+  uint64_t file_size;
+
+  /** Zeroes the header. */
+  BinaryDatasetHeader();
+
+  /**
+   * Creates a header for a dataset of the specified size: fills the magic,
+   * the version and computes the section offsets.
+   * @param[in] scalar_size the size of a feature value; pass the size of the
+   *                        bin index to create a binned file.
+   * @param[in] num_boundaries the size of the bin boundary table.
+   */
+  BinaryDatasetHeader(uint64_t rows, uint64_t dimensions,
+                      uint64_t num_queries,
+                      uint32_t scalar_size=sizeof(feature_t),
+                      uint64_t num_boundaries=0);
+
+  /** Whether the features are bin indices. */
+  inline bool binned() const { return scalar_size <= 2; }
+
+  /**
+   * Checks the magic, the version and the section offsets. Both raw and
+   * binned files are accepted; the readers check scalar_size.
+   */
+  bool valid(uint64_t actual_file_size) const;
+
+  /**
+   * Reads the header of @p file_name.
+   * @return @c false if the file cannot be read or is not a binary dataset.
+   */
+  bool read(const std::string& file_name);
+};
+
+/**
+ * Whether @p file_name starts with BINARY_DATASET_MAGIC, i.e. it should be
+ * read as a binary dataset instead of a text one.
+ */
+bool is_binary_dataset(const std::string& file_name);
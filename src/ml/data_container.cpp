@@ -1,43 +1,136 @@
 #include "ml/data_container.h"
 
+#include <algorithm>
+#include <stdexcept>
+
+#include "ml/binary_dataset.h"
+
 using Eigen::Map;
 
 DataContainer::DataContainer(size_t dimensions_) : dimensions(dimensions_) {}
 
+DataContainer::~DataContainer() {}
+
 InputDataContainer::InputDataContainer(size_t dimensions_)
-  : DataContainer(dimensions_), data_(ArrayXXd(1000, dimensions_)),
-    relevance_(ArrayXd(1000)), rows_read(0) {}
+  : DataContainer(dimensions_), qids_(ArrayXi(1000)),
+    data_(FeatureArray(1000, dimensions_)), relevance_(ArrayXd(1000)),
+    query_offsets_(1, 0), rows_read(0) {}
+
+void InputDataContainer::reserve_rows(ArrayXXd::Index rows) {
+  /* Expand the data matrix. */
+  if (data_.rows() < rows_read + rows) {
+    ArrayXXd::Index new_rows = std::max(2 * data_.rows(), rows_read + rows);
+    qids_.conservativeResize(new_rows);
+    data_.conservativeResize(new_rows, Eigen::NoChange);
+    relevance_.conservativeResize(new_rows);
+  }
+}
+
+void InputDataContainer::end_query() {
+  if (query_offsets_.back() != static_cast<size_t>(rows_read)) {
+    query_offsets_.push_back(rows_read);
+  }
+}
 
 void InputDataContainer::read_data_item(const int& qid,
     const Eigen::ArrayXd& features, const double& relevance) {
-  /* Expand the data matrix. */
-  if (data_.rows() == rows_read) {
-    data_.conservativeResize(Eigen::NoChange, 2 * data_.rows());
-    relevance_.conservativeResize(2 * relevance_.size());
+  if (rows_read > 0 && qids_(rows_read - 1) != qid) {
+    end_query();
   }
+  reserve_rows(1);
 
   // TODO: size() check?
-  data_.row(rows_read) = features.head(dimensions);
+  qids_(rows_read) = qid;
+  data_.row(rows_read) = features.head(dimensions).cast<feature_t>();
   relevance_(rows_read) = relevance;
   rows_read++;
 }
 
+void InputDataContainer::read_query_block(const int& qid,
+    const double* features, size_t rows, size_t stride, const int* relevance) {
+  typedef Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic,
+                       Eigen::RowMajor> RowMajorArray;
+  if (stride < dimensions) {
+    throw std::invalid_argument("the rows of the query block are shorter "
+                                "than the dimensions of the container");
+  }
+  /* The rows read one by one before form a query of their own. */
+  end_query();
+  ArrayXXd::Index n = static_cast<ArrayXXd::Index>(rows);
+  reserve_rows(n);
+
+  qids_.segment(rows_read, n).setConstant(qid);
+  data_.middleRows(rows_read, n) =
+      Map<const RowMajorArray, 0, Eigen::OuterStride<> >(
+          features, n, dimensions,
+          Eigen::OuterStride<>(static_cast<ArrayXXd::Index>(stride)))
+      .cast<feature_t>();
+  relevance_.segment(rows_read, n) =
+      Map<const ArrayXi>(relevance, n).cast<double>();
+  rows_read += n;
+  end_query();
+}
+
 void InputDataContainer::read_data_item(const int& qid,
-    double* const& features, const double& relevance) {
-  read_data_item(qid, Map<ArrayXd>(features, dimensions), relevance);
+    feature_t* const& features, const double& relevance) {
+  if (rows_read > 0 && qids_(rows_read - 1) != qid) {
+    end_query();
+  }
+  reserve_rows(1);
+
+  qids_(rows_read) = qid;
+  data_.row(rows_read) = Map<const Eigen::Array<feature_t, 1, Eigen::Dynamic> >(
+      features, dimensions);
+  relevance_(rows_read) = relevance;
+  rows_read++;
 }
 
 void InputDataContainer::finalize_data() {
+  end_query();
+  qids_.conservativeResize(rows_read);
   data_.conservativeResize(rows_read, Eigen::NoChange);
   relevance_.conservativeResize(rows_read);
 }
 
 ReferenceDataContainer::ReferenceDataContainer(
-    size_t dimensions_, const ArrayXi& qids__,
-    const ArrayXXd& data__, const ArrayXd& relevance__)
-  : DataContainer(dimensions_), qids_(qids__), data_(data__), relevance_(relevance__) {}
+    size_t dimensions_, const QidMap& qids__,
+    const DataMap& data__, const ArrayXd& relevance__)
+  : DataContainer(dimensions_), qids_(qids__), data_(data__),
+    relevance_(relevance__.data(), relevance__.size()) {}
 
 ReferenceDataContainer::ReferenceDataContainer(const DataContainer& data)
   : DataContainer(data.dimensions), qids_(data.qids()), data_(data.data()),
     relevance_(data.relevance()) {}
 
+
+MmapDataContainer::MmapDataContainer(const std::string& file_name)
+    : DataContainer(0) {
+  /* The tree learners access the columns over and over again. */
+  if (!file.open(file_name, false)) {
+    throw std::runtime_error("cannot map binary dataset " + file_name);
+  }
+  BinaryDatasetHeader header;
+  if (file.size() < sizeof(header)) {
+    throw std::runtime_error(file_name + " is not a binary dataset");
+  }
+  header = *reinterpret_cast<const BinaryDatasetHeader*>(file.begin());
+  if (!header.valid(file.size())) {
+    throw std::runtime_error(file_name + " is not a valid binary dataset");
+  }
+  if (header.scalar_size != sizeof(feature_t)) {
+    throw std::runtime_error(file_name + " is binned or was written with "
+                             "another feature type");
+  }
+
+  dimensions     = header.dimensions;
+  rows           = static_cast<ArrayXXd::Index>(header.rows);
+  num_queries_   = header.num_queries;
+  query_offsets_ = reinterpret_cast<const uint64_t*>(
+      file.begin() + header.query_offsets_pos);
+  qids_          = reinterpret_cast<const int*>(
+      file.begin() + header.qids_pos);
+  relevance_     = reinterpret_cast<const double*>(
+      file.begin() + header.relevance_pos);
+  data_          = reinterpret_cast<const feature_t*>(
+      file.begin() + header.features_pos);
+}
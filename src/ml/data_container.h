@@ -24,28 +24,50 @@
  * @todo A dense and a sparse container?
  */
 
+#include <string>
+#include <vector>
 #include <Eigen/Dense>
 
+#include <stdint.h>
+
+#include "tokenizer.h"  // MmapFile
+#include "ml/feature.h"
+
 using Eigen::ArrayXXd;
 using Eigen::ArrayXd;
 using Eigen::ArrayXi;
 
-/** Data container interface class. */
+/** The data matrix type; see ml/feature.h. */
+typedef Eigen::Array<feature_t, Eigen::Dynamic, Eigen::Dynamic> FeatureArray;
+
+/**
+ * Data container interface class. The data is returned as read-only
+ * @c Eigen::Map views, so that implementations are free to keep it in any
+ * (column-major) buffer, be it an Eigen array or a memory-mapped file.
+ */
 struct DataContainer {
+  /** Read-only view of the query ids. */
+  typedef Eigen::Map<const ArrayXi> QidMap;
+  /** Read-only view of the data matrix. */
+  typedef Eigen::Map<const FeatureArray> DataMap;
+  /** Read-only view of the relevance judgements. */
+  typedef Eigen::Map<const ArrayXd> RelevanceMap;
+
   /**
    * Constructor.
    * @param dimensions the number of features in the data.
    */
   DataContainer(size_t dimensions);
+  virtual ~DataContainer();
 
   /** The number of features in the data. */
   size_t dimensions;
   /** The query ids of the data points. */
-  virtual const ArrayXi& qids() const=0;
+  virtual QidMap qids() const=0;
   /** The data. */
-  virtual const ArrayXXd& data() const=0;
+  virtual DataMap data() const=0;
   /** The relevance judgements. */
-  virtual const ArrayXd& relevance() const=0;
+  virtual RelevanceMap relevance() const=0;
 };
 
 /**
@@ -64,26 +86,60 @@ public:
    * Reads a data point: the features and the relevance value, and stores them
    * in the data matrix.
    */
-  void read_data_item(const int& qid, double* const& features,
+  void read_data_item(const int& qid, feature_t* const& features,
                       const double& relevance);
   void read_data_item(const int& qid, const Eigen::ArrayXd& features,
                       const double& relevance);
 
+  /**
+   * Reads all data points of a query at once (see QueryBlock).
+   * @param[in] features the features of the @p rows documents: a row-major
+   *                     matrix whose rows start @p stride values apart. The
+   *                     first @c dimensions values of each row are read.
+   * @param[in] relevance the relevance of the @p rows documents.
+   * @throw std::invalid_argument if @p stride is less than @c dimensions.
+   */
+  void read_query_block(const int& qid, const double* features,
+                        size_t rows, size_t stride, const int* relevance);
+
   /** Finalizes the data; to be called after all data points have been read. */
   void finalize_data();
 
-  inline const ArrayXi& qids() const { return qids_; }
-  inline const ArrayXXd& data() const { return data_; }
-  inline const ArrayXd& relevance() const { return relevance_; }
+  inline QidMap qids() const {
+    return QidMap(qids_.data(), qids_.size());
+  }
+  inline DataMap data() const {
+    return DataMap(data_.data(), data_.rows(), data_.cols());
+  }
+  inline RelevanceMap relevance() const {
+    return RelevanceMap(relevance_.data(), relevance_.size());
+  }
+
+  /**
+   * The start of the rows of each query, plus the end of the last one. A
+   * query read by read_data_item() ends where the query id changes, so the
+   * offsets are only complete after finalize_data().
+   */
+  inline const std::vector<size_t>& query_offsets() const {
+    return query_offsets_;
+  }
 
 private:
+  /** Makes sure there is room for @p rows more data points. */
+  void reserve_rows(ArrayXXd::Index rows);
+  /** Ends the current query in query_offsets(), unless it is empty. */
+  void end_query();
+
   /** The query ids of the data points. */
   ArrayXi qids_;
   /** The data, read fully into memory. */
-  ArrayXXd data_;
+  FeatureArray data_;
   /** The relevance judgements associated with the data items in @c data. */
   ArrayXd relevance_;
 
+  /** See query_offsets(). */
+  std::vector<size_t> query_offsets_;
+
   /** The number of rows read thus far. */
   ArrayXXd::Index rows_read;
 };
@@ -91,17 +147,59 @@ private:
 /** Same as DataContainer, but the data is only referenced. */
 class ReferenceDataContainer : public DataContainer {
 public:
-  ReferenceDataContainer(size_t dimensions, const ArrayXi& qids,
-                         const ArrayXXd& data, const ArrayXd& relevance);
+  ReferenceDataContainer(size_t dimensions, const QidMap& qids,
+                         const DataMap& data, const ArrayXd& relevance);
   ReferenceDataContainer(const DataContainer& data);
 
-  inline const ArrayXi& qids() const { return qids_; }
-  inline const ArrayXXd& data() const { return data_; }
-  inline const ArrayXd& relevance() const { return relevance_; }
+  inline QidMap qids() const { return qids_; }
+  inline DataMap data() const { return data_; }
+  inline RelevanceMap relevance() const { return relevance_; }
+
+private:
+  QidMap qids_;
+  DataMap data_;
+  RelevanceMap relevance_;
+};
+
+/**
+ * DataContainer backed by a binary dataset file (see binary_dataset.h) mapped
+ * into memory. The data is not copied: the maps point directly into the
+ * mapping, so loading the data costs no more than the page faults.
+ */
+class MmapDataContainer : public DataContainer {
+public:
+  /**
+   * Maps @p file_name into memory.
+   * @throw std::runtime_error if the file cannot be mapped or is not a valid
+   *                           binary dataset file.
+   */
+  MmapDataContainer(const std::string& file_name);
+
+  inline QidMap qids() const { return QidMap(qids_, rows); }
+  inline DataMap data() const { return DataMap(data_, rows, dimensions); }
+  inline RelevanceMap relevance() const {
+    return RelevanceMap(relevance_, rows);
+  }
+
+  /** The number of queries (runs of rows with the same query id). */
+  inline size_t num_queries() const { return num_queries_; }
+  /**
+   * The query offset table: the rows of query @c i are
+   * <tt>[query_offsets()[i], query_offsets()[i + 1])</tt>.
+   */
+  inline const uint64_t* query_offsets() const { return query_offsets_; }
 
 private:
-  const ArrayXi& qids_;
-  const ArrayXXd& data_;
-  const ArrayXd& relevance_;
+  /** The mapped file. */
+  MmapFile file;
+  /** The number of rows. */
+  ArrayXXd::Index rows;
+  /** The number of queries. */
+  size_t num_queries_;
+  /** The sections of the file. */
+  const uint64_t* query_offsets_;
+  const int*      qids_;
+  const double*   relevance_;
+  const feature_t* data_;
 };
 
@@ -0,0 +1,33 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * The scalar type of the feature values stored in the shards and the data
+ * containers. It is @c double by default; compile with
+ * @c -DLTR_FLOAT_FEATURES to store them as @c float, which halves the I/O and
+ * memory traffic. Scores and gradients are always accumulated in @c double.
+ */
+
+#ifdef LTR_FLOAT_FEATURES
+typedef float feature_t;
+#else
+typedef double feature_t;
+#endif
@@ -0,0 +1,159 @@
+#include "ml/feature_quantizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "ml/binary_dataset.h"
+
+const size_t FeatureQuantizer::DEFAULT_SAMPLE_SIZE;
+
+FeatureQuantizer::FeatureQuantizer(size_t sample_size_)
+  : sample_size(sample_size_ > 0 ? sample_size_ : 1),
+    random_state(0x9e3779b97f4a7c15ULL), offsets_(1, 0) {}
+
+uint64_t FeatureQuantizer::next_random() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return random_state;
+}
+
+void FeatureQuantizer::add(size_t f, double value) {
+  if (std::isnan(value)) return;
+  std::vector<feature_t>& sample = samples[f];
+  uint64_t n = ++seen[f];
+  if (sample.size() < sample_size) {
+    sample.push_back(static_cast<feature_t>(value));
+  } else {
+    /* Reservoir sampling: keep the new value with probability k / n. */
+    uint64_t j = next_random() % n;
+    if (j < sample_size) {
+      sample[j] = static_cast<feature_t>(value);
+    }
+  }
+}
+
+void FeatureQuantizer::finalize(size_t max_bins) {
+  max_bins = std::min(std::max(max_bins, size_t(2)), size_t(65536));
+  offsets_.assign(1, 0);
+  boundaries_.clear();
+  for (size_t f = 0; f < samples.size(); f++) {
+    std::vector<feature_t>& sample = samples[f];
+    std::sort(sample.begin(), sample.end());
+    size_t distinct = sample.empty() ? 0 : 1;
+    for (size_t i = 1; i < sample.size() && distinct <= max_bins; i++) {
+      if (sample[i] != sample[i - 1]) distinct++;
+    }
+    if (distinct <= max_bins) {
+      /* Few values: each gets its own bin. */
+      for (size_t i = 1; i < sample.size(); i++) {
+        if (sample[i] != sample[i - 1]) boundaries_.push_back(sample[i]);
+      }
+    } else {
+      size_t first = boundaries_.size();
+      for (size_t b = 1; b < max_bins; b++) {
+        double value = sample[b * sample.size() / max_bins];
+        /* Bin 0 must not be empty, and the boundaries must increase. */
+        if (value > sample[0] &&
+            (boundaries_.size() == first || value > boundaries_.back())) {
+          boundaries_.push_back(value);
+        }
+      }
+    }
+    offsets_.push_back(boundaries_.size());
+    std::vector<feature_t>().swap(sample);
+  }
+  samples.clear();
+  seen.clear();
+}
+
+void FeatureQuantizer::set_boundaries(size_t dimensions,
+                                      const uint64_t* offsets,
+                                      const double* boundaries) {
+  offsets_.assign(offsets, offsets + dimensions + 1);
+  boundaries_.assign(boundaries, boundaries + offsets[dimensions]);
+}
+
+size_t FeatureQuantizer::max_num_bins() const {
+  size_t max_bins = 1;
+  for (size_t f = 0; f < dimensions(); f++) {
+    max_bins = std::max(max_bins, num_bins(f));
+  }
+  return max_bins;
+}
+
+uint16_t FeatureQuantizer::bin(size_t f, double value) const {
+  if (f >= dimensions()) return 0;
+  const double* begin = boundaries_.data() + offsets_[f];
+  const double* end   = boundaries_.data() + offsets_[f + 1];
+  return static_cast<uint16_t>(std::upper_bound(begin, end, value) - begin);
+}
+
+namespace {
+/** Bins column @p f of @p data into @p bins. */
+template <typename Bin>
+void bin_column(const DataContainer::DataMap& data, size_t f,
+                const FeatureQuantizer& quantizer, Bin* bins) {
+  for (ArrayXXd::Index i = 0; i < data.rows(); i++) {
+    bins[i] = static_cast<Bin>(quantizer.bin(f, data(i, f)));
+  }
+}
+}
+
+BinnedFeatures::BinnedFeatures(const DataContainer& data, size_t max_bins,
+                               size_t sample_size)
+  : quantizer_(sample_size) {
+  const DataContainer::DataMap data_ = data.data();
+  rows_ = static_cast<size_t>(data_.rows());
+  for (ArrayXXd::Index i = 0; i < data_.rows(); i++) {
+    /* The rows are not contiguous; this is only called once, though. */
+    Eigen::Array<feature_t, 1, Eigen::Dynamic> row = data_.row(i);
+    quantizer_.add_row(row.data(), data.dimensions);
+  }
+  quantizer_.finalize(max_bins);
+  bin_size = quantizer_.bin_size();
+
+  owned_bins.resize(rows_ * data.dimensions * bin_size);
+  for (size_t f = 0; f < data.dimensions; f++) {
+    if (wide()) {
+      bin_column(data_, f, quantizer_,
+                 reinterpret_cast<uint16_t*>(owned_bins.data()) + f * rows_);
+    } else {
+      bin_column(data_, f, quantizer_, owned_bins.data() + f * rows_);
+    }
+  }
+  bins_      = owned_bins.data();
+  qids_      = data.qids().data();
+  relevance_ = data.relevance().data();
+}
+
+BinnedFeatures::BinnedFeatures(const std::string& file_name) {
+  /* The tree learners access the columns over and over again. */
+  if (!file.open(file_name, false)) {
+    throw std::runtime_error("cannot map binary dataset " + file_name);
+  }
+  BinaryDatasetHeader header;
+  if (file.size() < sizeof(header)) {
+    throw std::runtime_error(file_name + " is not a binary dataset");
+  }
+  header = *reinterpret_cast<const BinaryDatasetHeader*>(file.begin());
+  if (!header.valid(file.size()) || !header.binned()) {
+    throw std::runtime_error(file_name + " is not a valid binned dataset");
+  }
+
+  rows_      = header.rows;
+  bin_size   = header.scalar_size;
+  bins_      = reinterpret_cast<const uint8_t*>(
+      file.begin() + header.features_pos);
+  qids_      = reinterpret_cast<const int*>(file.begin() + header.qids_pos);
+  relevance_ = reinterpret_cast<const double*>(
+      file.begin() + header.relevance_pos);
+  const uint64_t* offsets = reinterpret_cast<const uint64_t*>(
+      file.begin() + header.boundaries_pos);
+  if (offsets[header.dimensions] != header.num_boundaries) {
+    throw std::runtime_error(file_name + " is not a valid binned dataset");
+  }
+  quantizer_.set_boundaries(header.dimensions, offsets,
+      reinterpret_cast<const double*>(offsets + header.dimensions + 1));
+}
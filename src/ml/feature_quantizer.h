@@ -0,0 +1,205 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Feature quantization: the values of each feature are replaced by the index
+ * of the (quantile) bin they fall into. The tree learners only compare feature
+ * values, so they lose little by working on the bins, while a bin index takes
+ * one or two bytes instead of a feature_t.
+ */
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "tokenizer.h"  // MmapFile
+#include "ml/data_container.h"
+#include "ml/feature.h"
+
+/**
+ * Computes the bin boundaries of the features from a stream of rows. A
+ * fixed-size uniform sample (reservoir) is kept of the values of each feature,
+ * and the boundaries are set at the quantiles of the sample; if a feature has
+ * at most as many distinct values as bins, each value gets its own bin.
+ *
+ * Value @c v of feature @c f falls into bin @c b if
+ * <tt>boundary(f, b - 1) <= v < boundary(f, b)</tt>, i.e. the bins are
+ * ordered the same way as the values.
+ */
+class FeatureQuantizer {
+public:
+  /** The default number of values sampled per feature. */
+  static const size_t DEFAULT_SAMPLE_SIZE = 1 << 14;
+
+  /**
+   * @param[in] sample_size the number of values sampled per feature. If the
+   *                        data has at most this many rows, the boundaries
+   *                        are exact quantiles.
+   */
+  FeatureQuantizer(size_t sample_size=DEFAULT_SAMPLE_SIZE);
+
+  /**
+   * Adds a row to the sample. Rows shorter than the others are not padded;
+   * the missing values are simply not sampled.
+   */
+  template <typename T>
+  void add_row(const T* row, size_t length) {
+    if (length > samples.size()) {
+      samples.resize(length);
+      seen.resize(length, 0);
+    }
+    for (size_t f = 0; f < length; f++) {
+      add(f, static_cast<double>(row[f]));
+    }
+  }
+
+  /**
+   * Computes the boundaries from the sample, and frees the sample.
+   * @param[in] max_bins the maximum number of bins per feature; at most
+   *                     65536.
+   */
+  void finalize(size_t max_bins);
+
+  /** Sets the boundary table directly, e.g. from a binned dataset file. */
+  void set_boundaries(size_t dimensions, const uint64_t* offsets,
+                      const double* boundaries);
+
+  /** The number of features. */
+  inline size_t dimensions() const { return offsets_.size() - 1; }
+  /** The number of bins of feature @p f. */
+  inline size_t num_bins(size_t f) const {
+    return offsets_[f + 1] - offsets_[f] + 1;
+  }
+  /** The largest num_bins() over all features. */
+  size_t max_num_bins() const;
+  /** The size of a bin index: 1 if all features have at most 256 bins. */
+  inline uint32_t bin_size() const { return max_num_bins() <= 256 ? 1 : 2; }
+
+  /** The upper (exclusive) boundary of bin @p b of feature @p f. */
+  inline double boundary(size_t f, size_t b) const {
+    return boundaries_[offsets_[f] + b];
+  }
+
+  /** Returns the bin @p value falls into. */
+  uint16_t bin(size_t f, double value) const;
+
+  /**
+   * The boundary table: the boundaries of feature @c f are
+   * <tt>boundaries()[offsets()[f] ... offsets()[f + 1] - 1]</tt>.
+   */
+  inline const std::vector<uint64_t>& offsets() const { return offsets_; }
+  inline const std::vector<double>& boundaries() const { return boundaries_; }
+
+private:
+  /** Adds @p value to the sample of feature @p f. */
+  void add(size_t f, double value);
+
+  /** A xorshift generator, so that the sample is reproducible. */
+  uint64_t next_random();
+
+  /** The number of values sampled per feature. */
+  size_t sample_size;
+  /** The samples. */
+  std::vector<std::vector<feature_t> > samples;
+  /** The number of values seen per feature. */
+  std::vector<uint64_t> seen;
+  /** The state of next_random(). */
+  uint64_t random_state;
+
+  /** See offsets(). */
+  std::vector<uint64_t> offsets_;
+  /** See boundaries(). */
+  std::vector<double> boundaries_;
+};
+
+/**
+ * The binned counterpart of DataContainer: the features are stored as
+ * column-major bin indices (@c uint8_t or @c uint16_t, see wide()), along
+ * with the FeatureQuantizer that produced them.
+ */
+class BinnedFeatures {
+public:
+  /**
+   * Quantizes @p data in memory. @p data must outlive the object, as the
+   * query ids and the relevance are not copied.
+   * @param[in] max_bins the maximum number of bins per feature.
+   */
+  BinnedFeatures(const DataContainer& data, size_t max_bins=256,
+                 size_t sample_size=FeatureQuantizer::DEFAULT_SAMPLE_SIZE);
+
+  /**
+   * Maps a binned binary dataset (see binary_dataset.h) into memory.
+   * @throw std::runtime_error if the file cannot be mapped or is not a valid
+   *                           binned dataset file.
+   */
+  BinnedFeatures(const std::string& file_name);
+
+  inline size_t rows() const { return rows_; }
+  inline size_t dimensions() const { return quantizer_.dimensions(); }
+  inline const FeatureQuantizer& quantizer() const { return quantizer_; }
+
+  /** Whether the bin indices are @c uint16_t (or @c uint8_t). */
+  inline bool wide() const { return bin_size == 2; }
+
+  /**
+   * The bin indices of feature @p f. @p Bin must be @c uint16_t if wide(),
+   * and @c uint8_t otherwise.
+   */
+  template <typename Bin>
+  inline const Bin* column(size_t f) const {
+    return reinterpret_cast<const Bin*>(bins_) + f * rows_;
+  }
+
+  /** The bin of feature @p f in row @p row. */
+  inline uint16_t bin(size_t row, size_t f) const {
+    return wide() ? column<uint16_t>(f)[row] : column<uint8_t>(f)[row];
+  }
+
+  inline DataContainer::QidMap qids() const {
+    return DataContainer::QidMap(qids_, rows_);
+  }
+  inline DataContainer::RelevanceMap relevance() const {
+    return DataContainer::RelevanceMap(relevance_, rows_);
+  }
+
+private:
+  /* No copying. */
+  BinnedFeatures(const BinnedFeatures&);
+  BinnedFeatures& operator=(const BinnedFeatures&);
+
+  /** The bin boundaries. */
+  FeatureQuantizer quantizer_;
+  /** The number of rows. */
+  size_t rows_;
+  /** The size of a bin index. */
+  uint32_t bin_size;
+
+  /** The bins, if computed in memory. */
+  std::vector<uint8_t> owned_bins;
+  /** The mapped file, if read from a file. */
+  MmapFile file;
+
+  /** The data; points either to @c owned_bins, or into @c file. */
+  const uint8_t* bins_;
+  const int*     qids_;
+  const double*  relevance_;
+};
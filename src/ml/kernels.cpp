@@ -0,0 +1,46 @@
+#include "ml/kernels.h"
+
+#include <Eigen/Dense>
+
+using Eigen::Dynamic;
+using Eigen::Map;
+using Eigen::Matrix;
+
+namespace {
+
+/**
+ * The kernels. @p N is the length of the vectors, or @c Dynamic; in the former
+ * case, the compiler can unroll and vectorize the loops completely, and the
+ * @c n parameter is ignored.
+ */
+template <int N>
+double dot(const feature_t* x, const double* w, size_t n) {
+  return Map<const Matrix<feature_t, N, 1> >(x, n).template cast<double>()
+         .dot(Map<const Matrix<double, N, 1> >(w, n));
+}
+
+template <int N>
+void axpy(double* y, const feature_t* x, double alpha, size_t n) {
+  Map<Matrix<double, N, 1> >(y, n) +=
+      alpha * Map<const Matrix<feature_t, N, 1> >(x, n).template cast<double>();
+}
+
+}  // namespace
+
+DotKernel select_dot_kernel(size_t n) {
+  switch (n) {
+    case 46:  return &dot<46>;
+    case 136: return &dot<136>;
+    case 700: return &dot<700>;
+    default:  return &dot<Dynamic>;
+  }
+}
+
+AxpyKernel select_axpy_kernel(size_t n) {
+  switch (n) {
+    case 46:  return &axpy<46>;
+    case 136: return &axpy<136>;
+    case 700: return &axpy<700>;
+    default:  return &axpy<Dynamic>;
+  }
+}
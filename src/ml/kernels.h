@@ -0,0 +1,50 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Vector kernels specialized for the feature counts of the common LTR
+ * datasets (46: LETOR 4.0, 136: MSLR-WEB, 700: Yahoo). The number of features
+ * is only known at runtime, so the models select the kernel for their
+ * dimensions once, when they are created; other widths use a generic kernel.
+ *
+ * The features are of type @c feature_t, the weights are doubles; the
+ * features are widened to @c double before the arithmetic.
+ */
+
+#include <cstddef>
+
+#include "ml/feature.h"
+
+/**
+ * Returns the dot product of the @p n long feature vector @p x and weight
+ * vector @p w.
+ */
+typedef double (*DotKernel)(const feature_t* x, const double* w, size_t n);
+
+/** <tt>y += alpha * x</tt> for the @p n long vectors @p x and @p y. */
+typedef void (*AxpyKernel)(double* y, const feature_t* x, double alpha,
+                           size_t n);
+
+/** Returns the dot product kernel for @p n long vectors. */
+DotKernel select_dot_kernel(size_t n);
+
+/** Returns the axpy kernel for @p n long vectors. */
+AxpyKernel select_axpy_kernel(size_t n);
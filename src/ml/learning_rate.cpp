@@ -10,6 +10,18 @@
 LearningRate::LearningRate(double learning_rate_)
   : learning_rate(learning_rate_) {}
 
+size_t LearningRate::state_size() const {
+  return 1;
+}
+
+void LearningRate::save_state(double* state) const {
+  state[0] = learning_rate;
+}
+
+void LearningRate::restore_state(const double* state) {
+  learning_rate = state[0];
+}
+
 ConstantLearningRate::ConstantLearningRate(double learning_rate_)
     throw (std::invalid_argument) : LearningRate(learning_rate_) {
   if (learning_rate <= 0) {
@@ -98,6 +110,32 @@ void CompositeLearningRate::reset() {
   learning_rate = parts[index]->get();
 }
 
+size_t CompositeLearningRate::state_size() const {
+  size_t size = 2;
+  for (size_t i = 0; i < parts.size(); i++) {
+    size += parts[i]->state_size();
+  }
+  return size;
+}
+
+void CompositeLearningRate::save_state(double* state) const {
+  *state++ = learning_rate;
+  *state++ = static_cast<double>(index);
+  for (size_t i = 0; i < parts.size(); i++) {
+    parts[i]->save_state(state);
+    state += parts[i]->state_size();
+  }
+}
+
+void CompositeLearningRate::restore_state(const double* state) {
+  learning_rate = *state++;
+  index = static_cast<size_t>(*state++);
+  for (size_t i = 0; i < parts.size(); i++) {
+    parts[i]->restore_state(state);
+    state += parts[i]->state_size();
+  }
+}
+
 LearningRate* create_learning_rate_function(const std::string& reflection_name)
     throw (std::invalid_argument) {
   std::istringstream ss(reflection_name);
@@ -54,6 +54,20 @@ public:
   /** Resets the object to its starting state. */
   virtual void reset()=0;
 
+  /**
+   * The number of values save_state() writes. This default implementation
+   * returns 1: the current value is the whole state.
+   */
+  virtual size_t state_size() const;
+  /**
+   * Copies the state of the function (where it is in its domain) into
+   * @p state, which must have room for state_size() values. Checkpoints save
+   * it with the weights of the model.
+   */
+  virtual void save_state(double* state) const;
+  /** Sets the state to the one copied by save_state(). */
+  virtual void restore_state(const double* state);
+
   /**
    * Clones the model. Subclasses must implement it so that it calls the copy
    * constructor of the subclass in question.
@@ -126,6 +140,10 @@ public:
 
   bool advance();
   void reset();
+  /** The current value, the index and the states of the parts. */
+  size_t state_size() const;
+  void save_state(double* state) const;
+  void restore_state(const double* state);
   CompositeLearningRate* clone();
 
 private:
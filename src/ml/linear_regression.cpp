@@ -24,22 +24,41 @@
 
 #include "linear_regression.h"
 
+#include <algorithm>  // copy
 #include <sstream>
 #include <iostream>
 
 #include "ml/learning_rate.h"
 //#include <iterator>
 
-using Eigen::Map;
+namespace {
+/**
+ * The sparse dot product of @p weights (@p dimensions + 1 long, the last item
+ * is the noise) and @p features.
+ */
+double sparse_score(const double* weights, size_t dimensions,
+                    const feature_t* features, size_t nnz) {
+  double score = weights[dimensions];
+  for (size_t i = 0; i < nnz; i++) {
+    size_t index = static_cast<size_t>(features[2 * i]);
+    if (index < dimensions) {
+      score += weights[index] * features[2 * i + 1];
+    }
+  }
+  return score;
+}
+}
+
 
 LinearRegression::LinearRegression(
     size_t dimensions, LearningRate* learning_rate)
-  : DifferentiableModel(dimensions, learning_rate) {
+  : DifferentiableModel(dimensions, learning_rate),
+    dot(select_dot_kernel(dimensions)), axpy(select_axpy_kernel(dimensions)) {
   weights = VectorXd::Constant(dimensions + 1, 1);
 }
 
 LinearRegression::LinearRegression(LinearRegression& orig)
-    : DifferentiableModel(orig) {
+    : DifferentiableModel(orig), dot(orig.dot), axpy(orig.axpy) {
   weights = orig.weights;
 }
 
@@ -47,11 +66,38 @@ Gradient* LinearRegression::get_gradient_object() {
   return new LinearRegressionGradient(*this);
 }
 
-double LinearRegression::score(double* const& features) const {
-  double score = Map<VectorXd>(features, dimensions).transpose() *
-                 weights.head(dimensions);
-  score += weights[dimensions];
-  return score;
+double LinearRegression::score(feature_t* const& features) const {
+  return dot(features, weights.data(), dimensions) + weights[dimensions];
+}
+
+double LinearRegression::score_sparse(feature_t* const& features,
+                                      size_t nnz) const {
+  return sparse_score(weights.data(), dimensions, features, nnz);
+}
+
+bool LinearRegression::save(const std::string& file_name) const {
+  std::unique_ptr<ModelFileWriter> writer(snapshot_writer(weights.data()));
+  return writer->save(file_name);
+}
+
+size_t LinearRegression::num_parameters() const {
+  return static_cast<size_t>(weights.size());
+}
+
+void LinearRegression::snapshot_into(double* buffer) const {
+  std::copy(weights.data(), weights.data() + weights.size(), buffer);
+}
+
+void LinearRegression::restore_from(const double* buffer) {
+  std::copy(buffer, buffer + weights.size(), weights.data());
+}
+
+ModelFileWriter* LinearRegression::snapshot_writer(
+    const double* buffer) const {
+  ModelFileWriter* writer = new ModelFileWriter(LINEAR_REGRESSION, dimensions,
+                                                feature_layout);
+  writer->add_block(buffer, weights.size() * sizeof(double));
+  return writer;
 }
 
 LinearRegression* LinearRegression::clone() {
@@ -78,21 +124,38 @@ void LinearRegressionGradient::reset() {
 }
 
 void LinearRegressionGradient::update(
-    double* const& features, double output, double mult) {
+    feature_t* const& features, double output, double mult) {
   LinearRegression& p = static_cast<LinearRegression&>(parent);
-  gradients.head(p.dimensions) +=
-      Map<VectorXd>(features, p.dimensions) * mult * p.learning_rate->get();
+  p.axpy(gradients.data(), features, mult * p.learning_rate->get(),
+         p.dimensions);
   gradients[p.dimensions] += p.learning_rate->get() * mult;
 }
 
-void LinearRegressionGradient::__update_parent(size_t num_items) {
-  std::cout << "LINREG_UPDATE_PARENT ";
-  for (VectorXd::Index i = 0; i < gradients.size(); i++) {
-    std::cout << gradients[i] / num_items << " ";
+void LinearRegressionGradient::update_sparse(
+    feature_t* const& features, size_t nnz, double output, double mult) {
+  LinearRegression& p = static_cast<LinearRegression&>(parent);
+  double step = mult * p.learning_rate->get();
+  for (size_t i = 0; i < nnz; i++) {
+    size_t index = static_cast<size_t>(features[2 * i]);
+    if (index < p.dimensions) {
+      gradients[index] += features[2 * i + 1] * step;
+    }
   }
+  gradients[p.dimensions] += step;
+}
+
+void LinearRegressionGradient::merge(const Gradient& other) {
+  gradients += static_cast<const LinearRegressionGradient&>(other).gradients;
+}
+
+void LinearRegressionGradient::__update_parent(size_t num_items) {
+//  std::cout << "LINREG_UPDATE_PARENT ";
+//  for (VectorXd::Index i = 0; i < gradients.size(); i++) {
+//    std::cout << gradients[i] / num_items << " ";
+//  }
 //  std::copy(gradients.begin(), gradients.end(),
 //            std::ostream_iterator<double>(std::cout, " "));
-  std::cout << std::endl;
+//  std::cout << std::endl;
   static_cast<LinearRegression&>(parent).weights -= gradients / num_items;
 }
 
@@ -106,3 +169,40 @@ std::string LinearRegressionGradient::str() const {
   return ss.str();
 }
 
+
+MappedLinearRegression::MappedLinearRegression(
+    const std::shared_ptr<ModelFile>& file_)
+  : MlModel(file_->dimensions()), file(file_),
+    weights(file_->block<double>(0)),
+    dot(select_dot_kernel(file_->dimensions())) {}
+
+MappedLinearRegression* MappedLinearRegression::create(
+    const std::shared_ptr<ModelFile>& file) {
+  if (file->num_blocks() < 1 || file->num_blocks() > 2 ||
+      file->block_length<double>(0) != file->dimensions() + 1) {
+    return NULL;
+  }
+  return new MappedLinearRegression(file);
+}
+
+MappedLinearRegression* MappedLinearRegression::clone() {
+  return new MappedLinearRegression(file);
+}
+
+double MappedLinearRegression::score(feature_t* const& features) const {
+  return dot(features, weights, dimensions) + weights[dimensions];
+}
+
+double MappedLinearRegression::score_sparse(feature_t* const& features,
+                                            size_t nnz) const {
+  return sparse_score(weights, dimensions, features, nnz);
+}
+
+std::string MappedLinearRegression::str() const {
+  std::ostringstream ss;
+  ss << "MappedLinearRegression (dim: " << dimensions << "):";
+  for (size_t i = 0; i <= dimensions; i++) {
+    ss << " " << weights[i];
+  }
+  return ss.str();
+}
@@ -23,10 +23,14 @@
  * A simple linear regression model.
  */
 
+#include <memory>
+#include <string>
 #include <vector>
 #include <Eigen/Dense>
 
 #include "ml_model.h"
+#include "ml/kernels.h"
+#include "ml/model_file.h"
 
 using Eigen::VectorXd;
 
@@ -46,7 +50,18 @@ public:
 
   Gradient* get_gradient_object();
 
-  double score(double* const& features) const;
+  size_t num_parameters() const;
+  void snapshot_into(double* buffer) const;
+  void restore_from(const double* buffer);
+  ModelFileWriter* snapshot_writer(const double* buffer) const;
+
+  double score(feature_t* const& features) const;
+
+  /** Sparse dot product. */
+  double score_sparse(feature_t* const& features, size_t nnz) const;
+
+  /** Saves the weights; see ml/model_file.h. */
+  bool save(const std::string& file_name) const;
 
   /** Prints the weights. */
   std::string str() const;
@@ -55,6 +70,13 @@ public:
   /** The weight vector. Size is dimensions + 1, the last item is the noise. */
   VectorXd weights;
 
+private:
+  /** The kernels for the actual number of dimensions; see ml/kernels.h. */
+  DotKernel dot;
+  AxpyKernel axpy;
+
+public:
+
   friend class LinearRegressionGradient;
 };
 
@@ -66,7 +88,14 @@ public:
   void reset();
 
   /** Computes the gradients. */
-  void update(double* const& features, double output, double mult=1);
+  void update(feature_t* const& features, double output, double mult=1);
+
+  /** Computes the gradients; scatter-adds the sparse features. */
+  void update_sparse(feature_t* const& features, size_t nnz,
+                     double output, double mult=1);
+
+  /** Adds the gradients of @p other to ours. */
+  void merge(const Gradient& other);
 
   std::string str() const;
 
@@ -79,3 +108,35 @@ private:
   VectorXd gradients;
 };
 
+/**
+ * A LinearRegression model loaded by load_model(): it scores with the weights
+ * in the mapped model file.
+ */
+class MappedLinearRegression : public MlModel {
+public:
+  /**
+   * Returns the model in @p file, or @c NULL if the weight block does not
+   * match the dimensions.
+   */
+  static MappedLinearRegression* create(const std::shared_ptr<ModelFile>& file);
+
+  MappedLinearRegression* clone();
+
+  double score(feature_t* const& features) const;
+
+  /** Sparse dot product. */
+  double score_sparse(feature_t* const& features, size_t nnz) const;
+
+  /** Prints the weights. */
+  std::string str() const;
+
+private:
+  MappedLinearRegression(const std::shared_ptr<ModelFile>& file);
+
+  /** The model file; shared by the clones. */
+  std::shared_ptr<ModelFile> file;
+  /** The weights in @c file, as in LinearRegression. */
+  const double* weights;
+  DotKernel dot;
+};
+
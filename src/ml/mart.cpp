@@ -1,13 +1,15 @@
 #include "ml/mart.h"
 
+#include <algorithm>
 #include <map>
 
 #include "ml/data_container.h"
+#include "ml/feature_quantizer.h"
 #include "ml/learning_rate.h"
 #include "ml/regression_tree.h"
 
-MART::MART(LearningRate* learning_rate_)
-  : learning_rate(learning_rate_) {
+MART::MART(LearningRate* learning_rate_, size_t max_bins_)
+  : learning_rate(learning_rate_), max_bins(max_bins_) {
   if (learning_rate == NULL) {
     learning_rate = new ConstantLearningRate(0.9);
   }
@@ -26,19 +28,50 @@ double MART::dC_per_ds_i(const double S_ij, const double s_i, const double s_j)
 // TODO: This is already lambdamart, and not just because of the lambdas...
 //       Factor it out!
 void MART::learn(const DataContainer& data, size_t no_trees) {
-  /* The outputs for all data points in @c data. */
-  ArrayXd F       = ArrayXd::Zero(data.data().rows());
+  ensemble.set_dimensions(data.dimensions);
+  if (max_bins > 0) {
+    /* Quantize once; all trees are built on the same bins. */
+    BinnedFeatures binned(data, max_bins);
+    learn(binned, no_trees);
+    return;
+  }
+  learn_inner(data.qids(), data.relevance(),
+              [&](RegressionTree* rt, const ArrayXd& lambdas) {
+    // TODO: set these parameters? Or maybe use the ones in the papers?
+    ReferenceDataContainer tree_data(data.dimensions, data.qids(),
+                                     data.data(), lambdas);
+    return rt->build_tree(tree_data, 1e-6, 50);
+  }, no_trees);
+}
+
+void MART::learn(const BinnedFeatures& data, size_t no_trees) {
+  /* If binned by learn(const DataContainer&), the data may be wider. */
+  ensemble.set_dimensions(std::max(ensemble.get_dimensions(),
+                                   data.dimensions()));
+  learn_inner(data.qids(), data.relevance(),
+              [&](RegressionTree* rt, const ArrayXd& lambdas) {
+    return rt->build_tree(
+        data, DataContainer::RelevanceMap(lambdas.data(), lambdas.size()),
+        1e-6, 50);
+  }, no_trees);
+}
+
+void MART::learn_inner(const DataContainer::QidMap& qids,
+                       const DataContainer::RelevanceMap& relevance,
+                       const TreeBuilder& build, size_t no_trees) {
+  /* The outputs for all data points. */
+  ArrayXd F       = ArrayXd::Zero(relevance.size());
   /** The lambdas, alias the y_i's. */
   ArrayXd lambdas = ArrayXd::Zero(F.size());
   /** The w_i's (d^2C/ds_i^2). */
   ArrayXd w       = ArrayXd::Zero(F.size());
 
-  std::vector<ArrayXi::Index> qid_indices = queries(data);
+  std::vector<ArrayXi::Index> qid_indices = queries(qids);
 
   /* Initialize the metrics. */
   metric.resize(qid_indices.size() - 1);
   for (size_t i = 0; i < metric.size(); i++) {
-    metric[i].initialize(data.relevance().segment(
+    metric[i].initialize(relevance.segment(
           qid_indices[i], qid_indices[i + 1] - qid_indices[i]));
   }
 
@@ -48,14 +81,14 @@ void MART::learn(const DataContainer& data, size_t no_trees) {
     for (size_t qi = 0; qi < qid_indices.size() - 1; qi++) {
       metric[qi].rankings(F.segment(qid_indices[qi],
                                     qid_indices[qi + 1] - qid_indices[qi]));
-      const ArrayXd& rel_v = data.relevance().segment(
+      const ArrayXd& rel_v = relevance.segment(
           qid_indices[qi], qid_indices[qi + 1] - qid_indices[qi]);
       /* ... and then the i - ...*/
       for (ArrayXi::Index i = qid_indices[qi]; i < qid_indices[qi + 1] - 2; i++) {
-        int rel_i = static_cast<int>(data.relevance()(i));
+        int rel_i = static_cast<int>(relevance(i));
         /* ... - j pairs. */
         for (ArrayXi::Index j = i + 1; j < qid_indices[qi + 1] - 1; j++) {
-          int rel_j = static_cast<int>(data.relevance()(j));
+          int rel_j = static_cast<int>(relevance(j));
           if (rel_i != rel_j) {
             double S_ij = rel_i > rel_j ? 1 : -1;
             double delta_metric = fabs(metric[qi].delta(
@@ -73,10 +106,7 @@ void MART::learn(const DataContainer& data, size_t no_trees) {
     }  // for qi
 
     RegressionTree* rt = new RegressionTree();
-    // TODO: set these parameters? Or maybe use the ones in the papers?
-    ReferenceDataContainer tree_data(data.dimensions, data.qids(),
-                                     data.data(), lambdas);
-    ArrayXi node_mapping = rt->build_tree(tree_data, 1e-6, 50);
+    ArrayXi node_mapping = build(rt, lambdas);
     std::map<int, std::pair<double, double> > gamma_fraq;
     for (size_t i = 0; i < node_mapping.size(); i++) {
       std::pair<double, double>& pair = gamma_fraq[node_mapping(i)];
@@ -88,6 +118,7 @@ void MART::learn(const DataContainer& data, size_t no_trees) {
     }
 
     trees.add_model(rt, learning_rate->get());
+    ensemble.add_tree(*rt, learning_rate->get());
     /* Break if the end of the learning rate's interval is reached. */
     if (learning_rate->advance() == 0) {
       break;
@@ -95,8 +126,12 @@ void MART::learn(const DataContainer& data, size_t no_trees) {
   }  // for k
 }
 
-std::vector<ArrayXi::Index> MART::queries(const DataContainer& data) const {
-  const ArrayXi& qids = data.qids();
+bool MART::save(const std::string& file_name) const {
+  return ensemble.save(file_name);
+}
+
+std::vector<ArrayXi::Index> MART::queries(
+    const DataContainer::QidMap& qids) const {
   std::vector<ArrayXi::Index> ret;
   int last_qid = qids(0) - 1;
   for (ArrayXd::Index i = 0; i < qids.size(); i++) {
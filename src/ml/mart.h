@@ -24,32 +24,60 @@
  */
 
 #include <cstdlib>
+#include <functional>
+#include <string>
 #include <Eigen/Dense>
 
 #include "ndcg_optimizer.h"
 #include "ml/boosting.h"
+#include "ml/data_container.h"
+#include "ml/tree_ensemble.h"
 
 using Eigen::ArrayXXd;
 using Eigen::ArrayXd;
 using Eigen::ArrayXi;
 
-class DataContainer;
+class BinnedFeatures;
 class LearningRate;
 class RegressionTree;
 
 class MART {
 public:
-  MART(LearningRate* learning_rate=NULL);
+  /**
+   * @param max_bins if not 0, the trees are built on the features quantized
+   *                 into at most this many bins (see BinnedFeatures).
+   */
+  MART(LearningRate* learning_rate=NULL, size_t max_bins=0);
   ~MART();
 
   void learn(const DataContainer& data, size_t no_trees);
+  /** Learns from binned data, e.g. a binned binary dataset. */
+  void learn(const BinnedFeatures& data, size_t no_trees);
+
+  /** The trees learned, as a TreeEnsemble. */
+  inline const TreeEnsemble& get_ensemble() const { return ensemble; }
+
+  /** Saves the trees learned; see TreeEnsemble#save(). */
+  bool save(const std::string& file_name) const;
+  /** Sets the feature layout saved with the trees; see MlModel. */
+  inline void set_feature_layout(uint64_t layout) {
+    ensemble.set_feature_layout(layout);
+  }
 
 private:
+  /** Builds a tree that fits the lambdas; returns the node mapping. */
+  typedef std::function<ArrayXi(RegressionTree*, const ArrayXd&)> TreeBuilder;
+
+  /** The algorithm itself; the learn() methods only differ in @p build. */
+  void learn_inner(const DataContainer::QidMap& qids,
+                   const DataContainer::RelevanceMap& relevance,
+                   const TreeBuilder& build, size_t no_trees);
+
   /**
    * Returns the indices of the data items that belong to a different query than
-   * the one before them; called by learn().
+   * the one before them; called by learn_inner().
    */
-  std::vector<ArrayXi::Index> queries(const DataContainer& data) const;
+  std::vector<ArrayXi::Index> queries(const DataContainer::QidMap& qids) const;
 
   /** The derivative of C over s_i == lambda_ij. */
   double dC_per_ds_i(const double S_ij, const double s_i, const double s_j);
@@ -66,7 +94,12 @@ private:
   /** The (ignored) sigma parameter. */
   double sigma;
 
+  /** The maximum number of bins; 0 if the features are not binned. */
+  size_t max_bins;
+
   /** The boosting container -- could be a parent class too. */
   Boosting trees;
+  /** The trees in flat form, for scoring and saving. */
+  TreeEnsemble ensemble;
 };
 
@@ -25,22 +25,47 @@
 #include "ml/ml_model.h"
 #include "ml/learning_rate.h"
 
-MlModel::MlModel() {}
+void sparse_to_dense(const feature_t* features, size_t nnz, size_t dimensions,
+                     std::vector<feature_t>& dense) {
+  dense.assign(dimensions, 0);
+  for (size_t i = 0; i < nnz; i++) {
+    size_t index = static_cast<size_t>(features[2 * i]);
+    if (index < dimensions) {
+      dense[index] = features[2 * i + 1];
+    }
+  }
+}
+
+MlModel::MlModel()
+  : dimensions(0), feature_layout(0), learning_rate(NULL) {}
 
 MlModel::MlModel(size_t dimensions_, LearningRate* learning_rate_)
-  : dimensions(dimensions_), learning_rate(learning_rate_) {
+  : dimensions(dimensions_), feature_layout(0),
+    learning_rate(learning_rate_) {
   if (learning_rate == NULL) {
     learning_rate = new ConstantLearningRate(0.9);
   }
 }
 
 MlModel::MlModel(MlModel& orig)
-  : dimensions(orig.dimensions), learning_rate(orig.learning_rate->clone()) {}
+  : dimensions(orig.dimensions), feature_layout(orig.feature_layout),
+    learning_rate(orig.learning_rate->clone()) {}
 
 MlModel::~MlModel() {
   delete learning_rate;
 }
 
+bool MlModel::save(const std::string& file_name) const {
+  throw UnsupportedOperationException();
+}
+
+double MlModel::score_sparse(feature_t* const& features, size_t nnz) const {
+  std::vector<feature_t> dense;
+  sparse_to_dense(features, nnz, dimensions, dense);
+  feature_t* data = &dense[0];
+  return score(data);
+}
+
 DifferentiableModel::DifferentiableModel(
     size_t dimensions, LearningRate* learning_rate)
   : MlModel(dimensions, learning_rate) {}
@@ -50,8 +75,22 @@ DifferentiableModel::DifferentiableModel(DifferentiableModel& orig)
 
 Gradient::Gradient(DifferentiableModel& parent_) : parent(parent_) {}
 
+void Gradient::update_sparse(feature_t* const& features, size_t nnz,
+                             double output, double mult) {
+  std::vector<feature_t> dense;
+  sparse_to_dense(features, nnz, dimensions(), dense);
+  feature_t* data = &dense[0];
+  update(data, output, mult);
+}
+
 void Gradient::update_parent(size_t num_items) {
-  __update_parent(num_items);
+  if (num_items > 0) {
+    __update_parent(num_items);
+  }
   parent.learning_rate->advance();
 }
 
+void Gradient::apply(size_t num_items) {
+  __update_parent(num_items);
+}
+
@@ -23,11 +23,24 @@
  * This file contains the root classes of the machine learning model hierarchy.
  */
 #include <cstddef>  // size_t
+#include <string>
+#include <vector>
+
+#include <stdint.h>
 
 #include "object.h"
+#include "ml/feature.h"
 
 class LearningRate;
 class Gradient;
+class ModelFileWriter;
+
+/**
+ * Expands the @p nnz sparse features in @p features (see
+ * MlModel#score_sparse()) into the @p dimensions long vector @p dense.
+ */
+void sparse_to_dense(const feature_t* features, size_t nnz, size_t dimensions,
+                     std::vector<feature_t>& dense);
 
 class MlModel : public virtual Object {
 protected:
@@ -49,9 +62,20 @@ public:
   // TODO: argument type to template? parameter
   /**
    * Returns the score for an item with features @p features. 
-   * @note double* const& = const double[]&
+   * @note feature_t* const& = const feature_t[]&
+   */
+  virtual double score(feature_t* const& features) const=0;
+
+  /**
+   * Returns the score for an item whose features are given in sparse form:
+   * @p nnz (index, value) pairs packed into @p features, i.e.
+   * <tt>index0, value0, index1, value1, ...</tt> Indices not less than the
+   * dimensions of the model are ignored.
+   *
+   * This default implementation expands the features into a dense vector and
+   * calls score(); models that can do better should override it.
    */
-  virtual double score(double* const& features) const=0;
+  virtual double score_sparse(feature_t* const& features, size_t nnz) const;
 
   /**
    * Clones the model. Subclasses must implement it so that it calls the copy
@@ -59,9 +83,30 @@ public:
    */
   virtual MlModel* clone()=0;
 
+  /**
+   * Saves the model in the binary model format, which load_model() can map
+   * back; see ml/model_file.h. This default implementation throws
+   * UnsupportedOperationException.
+   */
+  virtual bool save(const std::string& file_name) const;
+
+  /** The number of dimensions of the feature vector. */
+  inline size_t get_dimensions() const { return dimensions; }
+
+  /**
+   * Sets the hash of the feature layout of the training data: which input
+   * features were dropped, and which were moved to the static features. It is
+   * saved with the model, and checked when the model is loaded to score
+   * another dataset. 0 means unknown.
+   */
+  inline void set_feature_layout(uint64_t layout) { feature_layout = layout; }
+  inline uint64_t get_feature_layout() const { return feature_layout; }
+
 protected:
   /** Dimensions of the feature vector. */
   size_t dimensions;
+  /** The hash of the feature layout; see set_feature_layout(). */
+  uint64_t feature_layout;
   /** The learning rate function. */
   LearningRate* learning_rate;
 };
@@ -92,6 +137,27 @@ public:
    */
   virtual Gradient* get_gradient_object()=0;
 
+  /** The number of parameters (weights) of the model. */
+  virtual size_t num_parameters() const=0;
+  /**
+   * Copies the parameters into @p buffer, which must have room for
+   * num_parameters() values. Cheaper than clone() for checkpointing: nothing
+   * is allocated.
+   */
+  virtual void snapshot_into(double* buffer) const=0;
+  /** Sets the parameters to those copied by snapshot_into(). */
+  virtual void restore_from(const double* buffer)=0;
+  /**
+   * Returns a writer of the model file that save() would write if the model
+   * had the parameters in @p buffer, copied by snapshot_into(). The writer
+   * does not copy @p buffer.
+   * @return the writer, or @c NULL if the model cannot be saved.
+   */
+  virtual ModelFileWriter* snapshot_writer(const double* buffer) const=0;
+
+  /** The learning rate function, e.g. to checkpoint its state. */
+  inline LearningRate& get_learning_rate() const { return *learning_rate; }
+
   friend class Gradient;
 };
 
@@ -116,22 +182,52 @@ public:
    * @param[in] output the output for the current item, i.e. score(features).
    * @param[in] mult a multiplier for the gradients. The LTR algorithm, for
    *                 example, passes d C/d s_i here.
-   * @note double* const& = const double[]&
+   * @note feature_t* const& = const feature_t[]&
+   */
+  virtual void update(feature_t* const& features, double output,
+                      double mult=1)=0;
+
+  /**
+   * Same as update(), but the features are in the sparse form described at
+   * MlModel#score_sparse(). This default implementation expands the features
+   * into a dense vector and calls update().
    */
-  virtual void update(double* const& features, double output, double mult=1)=0;
+  virtual void update_sparse(feature_t* const& features, size_t nnz,
+                             double output, double mult=1);
+
+  /**
+   * Adds the gradients collected by @p other to ours. @p other must be a
+   * gradient object of the same parent model (i.e. the same type).
+   */
+  virtual void merge(const Gradient& other)=0;
 
   /**
    * Updates the parent and advances the learning rate function.
    *
    * @param[in] num_items the size of the training set. Useful for batch
    *                      learning, where we have to take the average gradient.
+   *                      If 0, there are no gradients to apply, and only the
+   *                      learning rate is advanced.
    */
   void update_parent(size_t num_items);
 
+  /**
+   * Updates the parent, but does not advance the learning rate; for
+   * mini-batch learning. The gradient objects of a model may call it
+   * concurrently: the updates are applied without locking (Hogwild!), so
+   * concurrent updates to the same weight may be lost.
+   *
+   * @param[in] num_items the number of items in the mini-batch.
+   */
+  void apply(size_t num_items);
+
 protected:
   /** Updates the parent -- subclasses must implement this method. */
   virtual void __update_parent(size_t num_items)=0;
 
+  /** Returns the number of features the parent model expects. */
+  inline size_t dimensions() const { return parent.dimensions; }
+
   /** Reference to the parent. */
   DifferentiableModel& parent;
 };
@@ -0,0 +1,67 @@
+#include "ml/model_checkpoint.h"
+
+#include <cstdio>
+
+#include "ml/learning_rate.h"
+
+ModelCheckpoint::ModelCheckpoint()
+  : num_parameters(0), current(-1), writing(-1), write_ok(true) {}
+
+ModelCheckpoint::~ModelCheckpoint() {
+  wait();
+}
+
+void ModelCheckpoint::snapshot(const DifferentiableModel& model) {
+  int next = current == 0 ? 1 : 0;
+  /* The buffer may still be written to disk. */
+  if (writing == next) {
+    wait();
+  }
+  const LearningRate& learning_rate = model.get_learning_rate();
+  num_parameters = model.num_parameters();
+  /* Allocates only for the first snapshot. */
+  buffers[next].resize(num_parameters + learning_rate.state_size());
+  model.snapshot_into(buffers[next].data());
+  learning_rate.save_state(buffers[next].data() + num_parameters);
+  current = next;
+}
+
+void ModelCheckpoint::restore(DifferentiableModel& model) const {
+  model.restore_from(buffers[current].data());
+  model.get_learning_rate().restore_state(buffers[current].data() +
+                                          num_parameters);
+}
+
+void ModelCheckpoint::save_async(const DifferentiableModel& model,
+                                 const std::string& file_name) {
+  wait();
+  if (empty()) return;
+  const std::vector<double>& buffer = buffers[current];
+  file_writer.reset(model.snapshot_writer(buffer.data()));
+  if (file_writer.get() == NULL) {
+    write_ok = false;
+    return;
+  }
+  file_writer->add_block(buffer.data() + num_parameters,
+                         (buffer.size() - num_parameters) * sizeof(double));
+  writing = current;
+  writer = std::thread(&ModelCheckpoint::write, this, file_name);
+}
+
+bool ModelCheckpoint::wait() {
+  if (writer.joinable()) {
+    writer.join();
+  }
+  writing = -1;
+  return write_ok;
+}
+
+void ModelCheckpoint::write(std::string file_name) {
+  /* The old checkpoint is only replaced by a complete one. */
+  std::string tmp_name = file_name + ".tmp";
+  write_ok = file_writer->save(tmp_name) &&
+             rename(tmp_name.c_str(), file_name.c_str()) == 0;
+  if (!write_ok) {
+    perror("Cannot save the model checkpoint");
+  }
+}
@@ -0,0 +1,92 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * Checkpoints of the parameters of a DifferentiableModel.
+ */
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ml/ml_model.h"
+#include "ml/model_file.h"
+
+/**
+ * Keeps the parameters of the best model seen so far, e.g. for early
+ * stopping, together with the state of its learning rate function. A
+ * snapshot is a single copy into a preallocated buffer; there are two
+ * buffers, so that the last snapshot can be written to disk in the
+ * background (see save_async()) while the next one is taken.
+ */
+class ModelCheckpoint {
+public:
+  ModelCheckpoint();
+  /** Waits for the background write, if any. */
+  ~ModelCheckpoint();
+
+  /** Copies the parameters and the learning rate state of @p model. */
+  void snapshot(const DifferentiableModel& model);
+  /**
+   * Sets the parameters and the learning rate state of @p model to those of
+   * the last snapshot.
+   */
+  void restore(DifferentiableModel& model) const;
+  /** Whether there has been a snapshot. */
+  inline bool empty() const { return current < 0; }
+
+  /**
+   * Writes the last snapshot of @p model to @p file_name on a background
+   * thread, waiting for the previous write first. The file is a model file
+   * (see ml/model_file.h), so load_model() can read it; the learning rate
+   * state is its last block.
+   */
+  void save_async(const DifferentiableModel& model,
+                  const std::string& file_name);
+  /**
+   * Waits for the background write to finish.
+   * @return @c false if it failed.
+   */
+  bool wait();
+
+private:
+  /* No copying. */
+  ModelCheckpoint(const ModelCheckpoint&);
+  ModelCheckpoint& operator=(const ModelCheckpoint&);
+
+  /** Writes @c file_writer to @p file_name; the body of @c writer. */
+  void write(std::string file_name);
+
+  /** The parameters, followed by the learning rate state. */
+  std::vector<double> buffers[2];
+  /** The number of parameters in the buffers. */
+  size_t num_parameters;
+  /** The buffer that holds the last snapshot; @c -1 if none. */
+  int current;
+  /** The buffer being written by @c writer; @c -1 if none. */
+  int writing;
+  /** Whether the last write succeeded. */
+  bool write_ok;
+  /** The model file being written by @c writer. */
+  std::unique_ptr<ModelFileWriter> file_writer;
+  std::thread writer;
+};
@@ -0,0 +1,120 @@
+#include "ml/model_file.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "ml/linear_regression.h"
+#include "ml/neural_net.h"
+#include "ml/tree_ensemble.h"
+
+const char MODEL_FILE_MAGIC[8] = { 'L', 'T', 'R', 'M', 'O', 'D', 0, 0 };
+
+namespace {
+/** Rounds @p pos up to the next multiple of MODEL_FILE_ALIGNMENT. */
+inline uint64_t align(uint64_t pos) {
+  return (pos + MODEL_FILE_ALIGNMENT - 1) /
+         MODEL_FILE_ALIGNMENT * MODEL_FILE_ALIGNMENT;
+}
+}
+
+ModelFileWriter::ModelFileWriter(ModelType type, uint64_t dimensions,
+                                 uint64_t feature_layout) {
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic));
+  header.version    = MODEL_FILE_VERSION;
+  header.type       = type;
+  header.dimensions = dimensions;
+  header.feature_layout = feature_layout;
+  header.file_size  = align(sizeof(header));
+}
+
+void ModelFileWriter::set_param(size_t i, double value) {
+  header.params[i] = value;
+}
+
+void ModelFileWriter::add_block(const void* data, uint64_t size) {
+  size_t i = header.num_blocks++;
+  blocks[i] = data;
+  header.block_pos[i]  = header.file_size;
+  header.block_size[i] = size;
+  header.file_size     = align(header.file_size + size);
+}
+
+bool ModelFileWriter::save(const std::string& file_name) {
+  FILE* f = fopen(file_name.c_str(), "wb");
+  if (f == NULL) {
+    perror("Cannot save the model");
+    return false;
+  }
+  std::vector<char> padding(MODEL_FILE_ALIGNMENT, 0);
+  uint64_t pos = sizeof(header);
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  for (size_t i = 0; ok && i < header.num_blocks; i++) {
+    size_t pad = header.block_pos[i] - pos;
+    ok = fwrite(padding.data(), 1, pad, f) == pad &&
+         fwrite(blocks[i], 1, header.block_size[i], f) ==
+             header.block_size[i];
+    pos = header.block_pos[i] + header.block_size[i];
+  }
+  size_t pad = header.file_size - pos;
+  ok = ok && fwrite(padding.data(), 1, pad, f) == pad;
+  ok = fclose(f) == 0 && ok;
+  if (!ok) {
+    perror("Cannot save the model");
+  }
+  return ok;
+}
+
+ModelFile::ModelFile() {}
+
+bool ModelFile::open(const std::string& file_name) {
+  if (!file.open(file_name, false)) {
+    return false;
+  }
+  if (file.size() < sizeof(ModelFileHeader)) {
+    return false;
+  }
+  const ModelFileHeader& h = header();
+  if (memcmp(h.magic, MODEL_FILE_MAGIC, sizeof(h.magic)) != 0 ||
+      h.version != MODEL_FILE_VERSION || h.file_size != file.size() ||
+      h.num_blocks > MODEL_FILE_MAX_BLOCKS) {
+    return false;
+  }
+  for (size_t i = 0; i < h.num_blocks; i++) {
+    if (h.block_pos[i] % MODEL_FILE_ALIGNMENT != 0 ||
+        h.block_pos[i] + h.block_size[i] > h.file_size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+MlModel* load_model(const std::string& file_name) {
+  std::shared_ptr<ModelFile> file(new ModelFile());
+  if (!file->open(file_name)) {
+    fprintf(stderr, "%s is not a valid model file.\n", file_name.c_str());
+    return NULL;
+  }
+  MlModel* model = NULL;
+  switch (file->type()) {
+    case LINEAR_REGRESSION:
+      model = MappedLinearRegression::create(file);
+      break;
+    case NEURAL_NETWORK:
+      model = MappedNeuralNetwork::create(file);
+      break;
+    case TREE_ENSEMBLE:
+      model = TreeEnsemble::create(file);
+      break;
+    default:
+      fprintf(stderr, "Unknown model type %d in %s.\n", file->type(),
+              file_name.c_str());
+      return NULL;
+  }
+  if (model != NULL) {
+    model->set_feature_layout(file->feature_layout());
+  }
+  return model;
+}
@@ -0,0 +1,158 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * The binary model format. A model file consists of a ModelFileHeader and the
+ * weight blocks of the model, each aligned to @c MODEL_FILE_ALIGNMENT bytes,
+ * so that the file can be memory mapped and the blocks used in place; see
+ * load_model(). The blocks of each model type:
+ *
+ * - @c LINEAR_REGRESSION: the weights, <tt>dimensions + 1</tt> @c doubles;
+ * - @c NEURAL_NETWORK: the weights of the hidden layer, a column-major
+ *   <tt>(dimensions + 1) x hidden_neurons</tt> @c double matrix, and the
+ *   weights of the output layer, <tt>hidden_neurons + 1</tt> @c doubles.
+ *   @c params[0] is the number of hidden neurons, @c params[1] is the
+ *   parameter of the Sigma activation function;
+ * - @c TREE_ENSEMBLE: the FlatTreeNodes of all trees, the index of the root
+ *   node of each tree (@c uint32_t) and the weight of each tree (@c double);
+ *   see TreeEnsemble.
+ *
+ * A checkpoint of a LINEAR_REGRESSION or NEURAL_NETWORK model (see
+ * ModelCheckpoint) has one more block: the state of the learning rate
+ * function (@c doubles; see LearningRate#save_state()). load_model() ignores
+ * it.
+ *
+ * The header also records the feature layout of the training data (see
+ * MlModel#set_feature_layout()), so that a loaded model is not applied to
+ * documents whose features are dropped or split differently.
+ */
+
+#include <string>
+
+#include <stdint.h>
+
+#include "tokenizer.h"  // MmapFile
+
+class MlModel;
+
+/** The first bytes of a model file. */
+extern const char MODEL_FILE_MAGIC[8];
+/** The current version of the format. */
+const uint32_t MODEL_FILE_VERSION = 2;
+/** The alignment of the blocks in the file. */
+const uint64_t MODEL_FILE_ALIGNMENT = 64;
+/** The maximum number of blocks in a model file. */
+const size_t MODEL_FILE_MAX_BLOCKS = 4;
+
+/** The model types in a model file. */
+enum ModelType {
+  LINEAR_REGRESSION = 1,
+  NEURAL_NETWORK    = 2,
+  TREE_ENSEMBLE     = 3
+};
+
+/** The header of a model file. */
+struct ModelFileHeader {
+  char     magic[8];
+  uint32_t version;
+  /** A ModelType. */
+  uint32_t type;
+  /** The number of features the model expects. */
+  uint64_t dimensions;
+  /** The hash of the feature layout of the training data, or 0. */
+  uint64_t feature_layout;
+  /** Type-specific parameters. */
+  double   params[4];
+  uint64_t num_blocks;
+  /** The offsets and the sizes (in bytes) of the blocks. */
+  uint64_t block_pos[MODEL_FILE_MAX_BLOCKS];
+  uint64_t block_size[MODEL_FILE_MAX_BLOCKS];
+  /** The size of the whole file. */
+  uint64_t file_size;
+};
+
+/** Writes a model file. The blocks are not copied until save(). */
+class ModelFileWriter {
+public:
+  ModelFileWriter(ModelType type, uint64_t dimensions,
+                  uint64_t feature_layout=0);
+
+  /** Sets type-specific parameter @p i. */
+  void set_param(size_t i, double value);
+  /** Adds a block of @p size bytes; @p data must be valid until save(). */
+  void add_block(const void* data, uint64_t size);
+
+  /** Writes the file. */
+  bool save(const std::string& file_name);
+
+private:
+  ModelFileHeader header;
+  const void* blocks[MODEL_FILE_MAX_BLOCKS];
+};
+
+/** A model file mapped into memory. */
+class ModelFile {
+public:
+  ModelFile();
+
+  /**
+   * Maps file @p file_name into memory, and checks it.
+   * @return @c false if the file cannot be mapped or is not a valid model
+   *                  file.
+   */
+  bool open(const std::string& file_name);
+
+  inline ModelType type() const {
+    return static_cast<ModelType>(header().type);
+  }
+  inline uint64_t dimensions() const { return header().dimensions; }
+  inline uint64_t feature_layout() const { return header().feature_layout; }
+  inline double param(size_t i) const { return header().params[i]; }
+  inline uint64_t num_blocks() const { return header().num_blocks; }
+
+  /** Returns block @p i as an array of @c T. */
+  template <typename T>
+  inline const T* block(size_t i) const {
+    return reinterpret_cast<const T*>(file.begin() + header().block_pos[i]);
+  }
+  /** The number of @c T elements in block @p i. */
+  template <typename T>
+  inline uint64_t block_length(size_t i) const {
+    return header().block_size[i] / sizeof(T);
+  }
+
+private:
+  inline const ModelFileHeader& header() const {
+    return *reinterpret_cast<const ModelFileHeader*>(file.begin());
+  }
+
+  MmapFile file;
+};
+
+/**
+ * Loads a model saved by MlModel#save(). The returned model scores the
+ * documents with the weights in the mapped file, in place: loading is fast,
+ * and the processes that load the same file share its pages. The model can
+ * only score; it cannot be trained further.
+ *
+ * @return the model, or @c NULL if the file cannot be loaded.
+ */
+MlModel* load_model(const std::string& file_name);
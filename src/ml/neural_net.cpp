@@ -7,6 +7,10 @@
 using Eigen::Map;
 using Eigen::RowVectorXd;
 
+/** The feature vectors, as row / column vectors. */
+typedef Eigen::Matrix<feature_t, 1, Eigen::Dynamic> FeatureRowVector;
+typedef Eigen::Matrix<feature_t, Eigen::Dynamic, 1> FeatureVector;
+
 namespace {
 struct SigmaFunctor {
   SigmaFunctor(double K) : K(K) {}
@@ -22,17 +26,80 @@ void print_vec(const std::string& s, const VectorXd& v) {
   }
   std::cout << std::endl;
 }
+
+/**
+ * Applies the activation function to the inputs of the hidden layer in
+ * @p outputs1, and computes the score from the outputs with weights @p wy;
+ * the common part of network_score() and network_score_sparse().
+ */
+template <typename Vector>
+double output_score(const Vector& wy, const Activation& afn,
+                    VectorXd& outputs1) {
+  outputs1 = outputs1.unaryExpr(afn.act());  // TODO: into the previous expression
+//  for (VectorXd::Index i = 0; i < outputs1.size(); i++) {
+//    std::cout << "sigma(outputs[" << i << "]) == " << outputs1[i] << std::endl;
+//  }
+
+  double y = 0;
+  y = outputs1.transpose() * wy.head(outputs1.size())  // TODO: one line
+                           + wy(1);  // noise
+  y = afn.act()(y);
+
+  return y;
+}
+
+/**
+ * Scores the document with weights @p w1 and @p wy, and puts the outputs of
+ * layer 1 to @p outputs1; the body of NeuralNetwork::score_inner(), for both
+ * the Eigen matrices and the Maps of MappedNeuralNetwork. The input of each
+ * hidden neuron is the dot product of the features and its column in @p w1,
+ * computed by @p dot.
+ */
+template <typename Matrix, typename Vector>
+double network_score(feature_t* const& features, size_t dimensions,
+                     const Matrix& w1, const Vector& wy,
+                     const Activation& afn, DotKernel dot,
+                     VectorXd& outputs1) {
+  outputs1.resize(w1.cols());
+  for (typename Matrix::Index j = 0; j < w1.cols(); j++) {
+    outputs1(j) = dot(features, w1.col(j).data(), dimensions) +
+                  w1(dimensions, j);  // noise
+  }
+  return output_score(wy, afn, outputs1);
+}
+
+/**
+ * Same as network_score(), but the features are in the sparse form described
+ * at MlModel#score_sparse(): each adds its row of @p w1 to the hidden layer.
+ */
+template <typename Matrix, typename Vector>
+double network_score_sparse(feature_t* const& features, size_t nnz,
+                            size_t dimensions, const Matrix& w1,
+                            const Vector& wy, const Activation& afn,
+                            VectorXd& outputs1) {
+  outputs1 = w1.row(dimensions).transpose();  // noise
+  for (size_t i = 0; i < nnz; i++) {
+    size_t index = static_cast<size_t>(features[2 * i]);
+    if (index < dimensions) {
+      outputs1 += static_cast<double>(features[2 * i + 1]) *
+                  w1.row(index).transpose();
+    }
+  }
+  return output_score(wy, afn, outputs1);
+}
 };
 
 NeuralNetwork::NeuralNetwork(size_t dimensions, size_t hidden_neurons,
                              LearningRate* learning_rate, Activation* act_fn)
-    : DifferentiableModel(dimensions, learning_rate), hidden_neurons(hidden_neurons) {
+    : DifferentiableModel(dimensions, learning_rate), hidden_neurons(hidden_neurons),
+      dot(select_dot_kernel(dimensions)), axpy(select_axpy_kernel(dimensions)) {
   initialize_weights(hidden_neurons);
   outputs = VectorXd::Zero(hidden_neurons);
   afn.reset(act_fn != NULL ? act_fn : new Sigma(1));
 }
 
-NeuralNetwork::NeuralNetwork(NeuralNetwork& orig) : DifferentiableModel(orig) {
+NeuralNetwork::NeuralNetwork(NeuralNetwork& orig)
+    : DifferentiableModel(orig), dot(orig.dot), axpy(orig.axpy) {
   afn.reset(orig.afn->clone());
   w1 = orig.w1;
   wy = orig.wy;
@@ -44,28 +111,66 @@ NeuralNetwork* NeuralNetwork::clone() {
   return new NeuralNetwork(*this);
 }
 
-double NeuralNetwork::score(double* const& features) const {
+size_t NeuralNetwork::num_parameters() const {
+  return static_cast<size_t>(w1.size() + wy.size());
+}
+
+void NeuralNetwork::snapshot_into(double* buffer) const {
+  buffer = std::copy(w1.data(), w1.data() + w1.size(), buffer);
+  std::copy(wy.data(), wy.data() + wy.size(), buffer);
+}
+
+void NeuralNetwork::restore_from(const double* buffer) {
+  std::copy(buffer, buffer + w1.size(), w1.data());
+  buffer += w1.size();
+  std::copy(buffer, buffer + wy.size(), wy.data());
+}
+
+double NeuralNetwork::score(feature_t* const& features) const {
   return score_inner(features, outputs);
 }
 
-double NeuralNetwork::score_inner(double* const& features,
+double NeuralNetwork::score_inner(feature_t* const& features,
                                   VectorXd& outputs1) const {
-  outputs1 = Map<RowVectorXd>(features, dimensions) * w1.topRows(w1.rows() - 1)
-             + w1.bottomRows(1);  // noise
-//  for (VectorXd::Index i = 0; i < outputs1.size(); i++) {
-//    std::cout << "outputs[" << i << "] == " << outputs1[i] << std::endl;
-//  }
-  outputs1 = outputs1.unaryExpr(afn->act());  // TODO: into the previous expression
-//  for (VectorXd::Index i = 0; i < outputs1.size(); i++) {
-//    std::cout << "sigma(outputs[" << i << "]) == " << outputs1[i] << std::endl;
-//  }
+  return network_score(features, dimensions, w1, wy, *afn, dot, outputs1);
+}
 
-  double y = 0;
-  y = outputs1.transpose() * wy.head(hidden_neurons)  // TODO: one line
-                           + wy(1);  // noise
-  y = afn->act()(y);
+double NeuralNetwork::score_sparse(feature_t* const& features,
+                                   size_t nnz) const {
+  return score_sparse_inner(features, nnz, outputs);
+}
 
-  return y;
+double NeuralNetwork::score_sparse_inner(feature_t* const& features,
+                                         size_t nnz,
+                                         VectorXd& outputs1) const {
+  return network_score_sparse(features, nnz, dimensions, w1, wy, *afn,
+                              outputs1);
+}
+
+bool NeuralNetwork::save(const std::string& file_name) const {
+  std::unique_ptr<ModelFileWriter> w(writer(w1.data(), wy.data()));
+  return w.get() != NULL && w->save(file_name);
+}
+
+ModelFileWriter* NeuralNetwork::snapshot_writer(const double* buffer) const {
+  return writer(buffer, buffer + w1.size());
+}
+
+ModelFileWriter* NeuralNetwork::writer(const double* w1_data,
+                                       const double* wy_data) const {
+  const Sigma* sigma = dynamic_cast<const Sigma*>(afn.get());
+  if (sigma == NULL) {
+    std::cerr << "Only networks with a Sigma activation function can be "
+              << "saved." << std::endl;
+    return NULL;
+  }
+  ModelFileWriter* w = new ModelFileWriter(NEURAL_NETWORK, dimensions,
+                                           feature_layout);
+  w->set_param(0, static_cast<double>(hidden_neurons));
+  w->set_param(1, sigma->parameter());
+  w->add_block(w1_data, w1.size() * sizeof(double));
+  w->add_block(wy_data, wy.size() * sizeof(double));
+  return w;
 }
 
 Gradient* NeuralNetwork::get_gradient_object() {
@@ -126,47 +231,54 @@ void NeuralNetworkGradient::reset() {
   gradientsy = VectorXd::Zero(gradientsy.size());
 }
 
-void NeuralNetworkGradient::update(double* const& features,
+void NeuralNetworkGradient::update(feature_t* const& features,
                                    double y, double mult) {
   NeuralNetwork& p = static_cast<NeuralNetwork&>(parent);
   /* Have to run score() again to fill up the outputs vector... */
   p.score_inner(features, outputs);
+  update_layers(y, mult);
+  for (WeightMatrix::Index j = 0; j < gradients1.cols(); j++) {
+    p.axpy(gradients1.col(j).data(), features, steps(j), p.dimensions);
+  }
+}
 
-//  std::cout << "updating " << features[0] << ", " << features[1] << ", " << features[2] << "..." << std::endl;
-//  std::cout << "Outputs ";
-//  for (VectorXd::Index i = 0; i < outputs.size(); i++) {
-//    std::cout << outputs(i) << " ";
-//  }
-////  std::copy(outputs.begin(), outputs.end(),
-////            std::ostream_iterator<double>(std::cout, " "));
-//  std::cout << std::endl;
+void NeuralNetworkGradient::update_sparse(feature_t* const& features,
+                                          size_t nnz, double y, double mult) {
+  NeuralNetwork& p = static_cast<NeuralNetwork&>(parent);
+  p.score_sparse_inner(features, nnz, outputs);
+  update_layers(y, mult);
+  for (size_t i = 0; i < nnz; i++) {
+    size_t index = static_cast<size_t>(features[2 * i]);
+    if (index < p.dimensions) {
+      gradients1.row(index) += static_cast<double>(features[2 * i + 1]) *
+                               steps.transpose();
+    }
+  }
+}
 
+void NeuralNetworkGradient::update_layers(double y, double mult) {
+  NeuralNetwork& p = static_cast<NeuralNetwork&>(parent);
   /* First, let's update the output layer. */
   //double deltay = y * (1 - y);
   double deltay = p.afn->deriv()(y);
-//  std::cout << "deltay == " << deltay << std::endl;
   double plmdy = p.learning_rate->get() * mult * deltay;
 
   gradientsy.head(p.hidden_neurons) += plmdy * outputs;
   gradientsy(p.hidden_neurons) += plmdy;  // noise
-//  std::cout << "Updating wy -= " << p.learning_rate->get() << " * " << mult
-//            << " * " << deltay << " * outputs" << std::endl;
-//  print_vec("Gradientsy:", gradientsy);
 
   //VectorXd deltah = (outputs.array() * (1 - outputs.array())).matrix();
   VectorXd deltah = outputs.unaryExpr(p.afn->deriv());
-//  print_vec("deltah:", deltah);
   /* y'(1) * w(2) -- shouldn't be matched like this, not readable */
-  VectorXd deltah_wy = (p.wy.head(p.hidden_neurons).array() * deltah.array());
-//  print_vec("p.wy:", p.wy);
-//  print_vec("deltah_wy:", deltah_wy);
-//  std::cout << "Updating neurons with lr " << p.learning_rate->get()
-//            << " * deltay " << deltay << " * mult " << mult << std::endl;
-  gradients1.topRows(gradients1.rows() - 1) += plmdy *
-                Map<VectorXd>(features, p.dimensions) * deltah_wy.transpose();
-  gradients1.bottomRows(1) += plmdy * deltah_wy.transpose();  // noise
-//  std::cout << "delta gradients1: " << std::endl << p.learning_rate->get() * mult * deltay * Map<VectorXd>(features, p.dimensions) * deltah_wy.transpose() << std::endl;
-//  std::cout << "gradients1: " << std::endl << gradients1 << std::endl;
+  steps = plmdy *
+      (p.wy.head(p.hidden_neurons).array() * deltah.array()).matrix();
+  gradients1.bottomRows(1) += steps.transpose();  // noise
+}
+
+void NeuralNetworkGradient::merge(const Gradient& other) {
+  const NeuralNetworkGradient& o =
+      static_cast<const NeuralNetworkGradient&>(other);
+  gradients1 += o.gradients1;
+  gradientsy += o.gradientsy;
 }
 
 void NeuralNetworkGradient::__update_parent(size_t num_items) {
@@ -194,3 +306,45 @@ std::string NeuralNetworkGradient::str() const {
   return ss.str();
 }
 
+MappedNeuralNetwork::MappedNeuralNetwork(
+    const std::shared_ptr<ModelFile>& file_)
+  : MlModel(file_->dimensions()), file(file_), afn(file_->param(1)),
+    w1(file_->block<double>(0), file_->dimensions() + 1,
+       static_cast<WeightMatrix::Index>(file_->param(0))),
+    wy(file_->block<double>(1), file_->block_length<double>(1)),
+    dot(select_dot_kernel(file_->dimensions())) {}
+
+MappedNeuralNetwork* MappedNeuralNetwork::create(
+    const std::shared_ptr<ModelFile>& file) {
+  uint64_t hidden_neurons = static_cast<uint64_t>(file->param(0));
+  if (file->num_blocks() < 2 || file->num_blocks() > 3 ||
+      file->block_length<double>(0) !=
+          (file->dimensions() + 1) * hidden_neurons ||
+      file->block_length<double>(1) != hidden_neurons + 1) {
+    return NULL;
+  }
+  return new MappedNeuralNetwork(file);
+}
+
+MappedNeuralNetwork* MappedNeuralNetwork::clone() {
+  return new MappedNeuralNetwork(file);
+}
+
+double MappedNeuralNetwork::score(feature_t* const& features) const {
+  VectorXd outputs;
+  return network_score(features, dimensions, w1, wy, afn, dot, outputs);
+}
+
+double MappedNeuralNetwork::score_sparse(feature_t* const& features,
+                                         size_t nnz) const {
+  VectorXd outputs;
+  return network_score_sparse(features, nnz, dimensions, w1, wy, afn,
+                              outputs);
+}
+
+std::string MappedNeuralNetwork::str() const {
+  std::ostringstream ss;
+  ss << "MappedNeuralNetwork (dim: " << dimensions << ", hidden neurons: "
+     << w1.cols() << ")";
+  return ss.str();
+}
@@ -37,7 +37,9 @@
 #include <iostream>
 #include <Eigen/Dense>
 
+#include "ml/kernels.h"
 #include "ml/neural_net_activation.h"
+#include "ml/model_file.h"
 
 using Eigen::MatrixXd;
 using Eigen::VectorXd;
@@ -73,21 +75,44 @@ public:
 
   NeuralNetwork* clone();
 
-  inline double score(double* const& features) const;
+  /**
+   * Saves the weights; see ml/model_file.h. Only networks with a Sigma
+   * activation function can be saved.
+   */
+  bool save(const std::string& file_name) const;
+
+  inline double score(feature_t* const& features) const;
+
+  /** Scatters the sparse features into the hidden layer. */
+  double score_sparse(feature_t* const& features, size_t nnz) const;
 
   /** Prints the weights. */
   std::string str() const;
 
   Gradient* get_gradient_object();
 
+  /** The parameters are @c w1 (in column-major order), then @c wy. */
+  size_t num_parameters() const;
+  void snapshot_into(double* buffer) const;
+  void restore_from(const double* buffer);
+  ModelFileWriter* snapshot_writer(const double* buffer) const;
+
 private:
   /**
    * Scores the document and puts the outputs of layer 1 to @p outputs1.
    * score() invokes this method with @c outputs as @p outputs1.
    */
-  double score_inner(double* const& features,
+  double score_inner(feature_t* const& features,
                      VectorXd& outputs1) const;
 //                     std::vector<double>& outputs1) const;
+  /** score_inner() for score_sparse(). */
+  double score_sparse_inner(feature_t* const& features, size_t nnz,
+                            VectorXd& outputs1) const;
+  /**
+   * Returns a writer of the network with weights @p w1_data and @p wy_data,
+   * laid out as @c w1 and @c wy; @c NULL if the network cannot be saved.
+   */
+  ModelFileWriter* writer(const double* w1_data, const double* wy_data) const;
   /** Initializes the individual weights to random numbers between 0.1 and 1. */
   void initialize_weights(size_t hidden_neurons);
 
@@ -108,6 +133,16 @@ public:
   WeightVector::Index hidden_neurons;
   // TODO unsigned - signed conversion can cause problems
 
+private:
+  /**
+   * The kernels for the actual number of dimensions, applied to the columns
+   * of @c w1; see ml/kernels.h.
+   */
+  DotKernel dot;
+  AxpyKernel axpy;
+
+public:
+
   friend class NeuralNetworkGradient;
   // TODO: to Object?
   friend std::ostream& operator<<(std::ostream& os, const NeuralNetwork& nn);
@@ -122,7 +157,14 @@ public:
   /** Resets the gradients to 0. */
   void reset();
 
-  void update(double* const& features, double y, double mult=1);
+  void update(feature_t* const& features, double y, double mult=1);
+
+  /** Computes the gradients; scatter-adds the sparse features. */
+  void update_sparse(feature_t* const& features, size_t nnz,
+                     double y, double mult=1);
+
+  /** Adds the gradients of @p other to ours. */
+  void merge(const Gradient& other);
 
   std::string str() const;
 
@@ -131,14 +173,60 @@ protected:
   void __update_parent(size_t num_items);
 
 private:
+  /**
+   * Updates the gradients of the output layer and of the noise inputs of the
+   * hidden layer from @c outputs, and computes @c steps; the part of update()
+   * and update_sparse() that does not depend on the features.
+   */
+  void update_layers(double y, double mult);
+
   /**
    * The outputs of the first layer. Needed as we need to run our parent's
    * score method to compute all gradients.
    */
   VectorXd outputs;
+  /**
+   * The step of each hidden neuron: its gradient is @c features times its
+   * step.
+   */
+  VectorXd steps;
   /** Gradients for the first layer. */
   WeightMatrix gradients1;
   /** Gradients for the output layer. */
   WeightVector gradientsy;
 };
 
+/**
+ * A NeuralNetwork loaded by load_model(): it scores with the weights in the
+ * mapped model file.
+ */
+class MappedNeuralNetwork : public MlModel {
+public:
+  /**
+   * Returns the model in @p file, or @c NULL if the weight blocks do not
+   * match the dimensions.
+   */
+  static MappedNeuralNetwork* create(const std::shared_ptr<ModelFile>& file);
+
+  MappedNeuralNetwork* clone();
+
+  double score(feature_t* const& features) const;
+
+  /** Scatters the sparse features into the hidden layer. */
+  double score_sparse(feature_t* const& features, size_t nnz) const;
+
+  std::string str() const;
+
+private:
+  MappedNeuralNetwork(const std::shared_ptr<ModelFile>& file);
+
+  /** The model file; shared by the clones. */
+  std::shared_ptr<ModelFile> file;
+  /** The activation function. */
+  Sigma afn;
+  /** The weights in @c file, as in NeuralNetwork. */
+  Eigen::Map<const WeightMatrix> w1;
+  Eigen::Map<const WeightVector> wy;
+  /** The dot product kernel for the dimensions; see ml/kernels.h. */
+  DotKernel dot;
+};
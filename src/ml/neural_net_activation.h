@@ -107,6 +107,9 @@ public:
 
   Sigma* clone();
 
+  /** The parameter @c K. */
+  inline double parameter() const { return K; }
+
 private:
   /** Parameter for @c sigma. */
   double K;
@@ -1,8 +1,12 @@
 #include "ml/regression_tree.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 #include "ml/data_container.h"
+#include "ml/feature_quantizer.h"
+#include "ml/tree_ensemble.h"
 #include "ml/utils.h"
 
 using Eigen::Map;
@@ -44,6 +48,7 @@ void RegressionTree::create_sorted(const DataContainer& data) {
 
 ArrayXi RegressionTree::build_tree(const DataContainer& data, double delta, size_t q) {
   create_sorted(data);
+  dimensions = data.dimensions;
 
   tree = new RealNode(0);
   tree->output = data.relevance().sum() / data.relevance().size();
@@ -62,8 +67,8 @@ void RegressionTree::split_node(Node* node, const DataContainer& data,
                                 ArrayXi::Index num_docs, double delta, size_t q) {
   double min_error   = node->error;
   size_t min_feature = data.dimensions;
-  const ArrayXXd& data_    = data.data();
-  const ArrayXXd& outputs_ = data.relevance();
+  const DataContainer::DataMap data_         = data.data();
+  const DataContainer::RelevanceMap outputs_ = data.relevance();
   double min_value   = 0;
   double min_left_error  = 0;
   double min_right_error = 0;
@@ -118,7 +123,7 @@ void RegressionTree::split_node(Node* node, const DataContainer& data,
           min_error   = curr_error;
           min_feature = f;
           // last_value/2.
-          min_value   = isnan(last_value)
+          min_value   = std::isnan(last_value)
                         ? curr_value - epsilon
                         : (last_value + curr_value) / 2;
           min_left_error = left_error;
@@ -164,6 +169,136 @@ void RegressionTree::split_node(Node* node, const DataContainer& data,
   }
 }
 
+namespace {
+/** The sums of the outputs that fall into a bin. */
+struct BinStats {
+  double count;
+  double sum;
+  double sum_sq;
+
+  BinStats() : count(0), sum(0), sum_sq(0) {}
+  inline void add(double output) {
+    count++;
+    sum += output;
+    sum_sq += output * output;
+  }
+  inline void add(const BinStats& other) {
+    count += other.count;
+    sum += other.sum;
+    sum_sq += other.sum_sq;
+  }
+  /** The squared error around the mean. */
+  inline double error() const {
+    return count > 0 ? std::max(sum_sq - sum * sum / count, 0.0) : 0;
+  }
+};
+
+/** Fills @p histogram from the rows <tt>rows[begin, end)</tt>. */
+template <typename Bin>
+void fill_histogram(const Bin* column,
+                    const DataContainer::RelevanceMap& outputs,
+                    const std::vector<int>& rows, size_t begin, size_t end,
+                    std::vector<BinStats>& histogram) {
+  for (size_t i = begin; i < end; i++) {
+    histogram[column[rows[i]]].add(outputs(rows[i]));
+  }
+}
+}
+
+ArrayXi RegressionTree::build_tree(const BinnedFeatures& data,
+                                   const DataContainer::RelevanceMap& outputs,
+                                   double delta, size_t q) {
+  tree = new RealNode(0);
+  tree->output = outputs.sum() / outputs.size();
+  tree->error  = (outputs - tree->output).pow(2).sum();
+  ArrayXi valid = ArrayXi::Zero(data.rows());
+  std::vector<int> rows(data.rows());
+  for (size_t i = 0; i < rows.size(); i++) rows[i] = static_cast<int>(i);
+  int max_id = 0;
+  split_node_binned(tree, data, outputs, rows, 0, rows.size(), valid, max_id,
+                    delta, q);
+  dimensions = data.dimensions();
+
+  num_nodes_ = static_cast<size_t>(max_id) + 1;
+  return valid;
+}
+
+void RegressionTree::split_node_binned(
+    Node* node, const BinnedFeatures& data,
+    const DataContainer::RelevanceMap& outputs,
+    std::vector<int>& rows, size_t begin, size_t end,
+    ArrayXi& valid, int& max_id, double delta, size_t q) {
+  const FeatureQuantizer& quantizer = data.quantizer();
+  double min_error   = node->error;
+  size_t min_feature = data.dimensions();
+  size_t min_bin     = 0;
+  BinStats min_left, min_right;
+
+  std::vector<BinStats> histogram;
+  for (size_t f = 0; f < data.dimensions(); f++) {
+    size_t num_bins = quantizer.num_bins(f);
+    if (num_bins < 2) continue;  // Constant feature
+    histogram.assign(num_bins, BinStats());
+    if (data.wide()) {
+      fill_histogram(data.column<uint16_t>(f), outputs, rows, begin, end,
+                     histogram);
+    } else {
+      fill_histogram(data.column<uint8_t>(f), outputs, rows, begin, end,
+                     histogram);
+    }
+    BinStats total;
+    for (size_t b = 0; b < num_bins; b++) total.add(histogram[b]);
+
+    /* Split after bin b: bins [0, b] go to the left. */
+    BinStats left;
+    for (size_t b = 0; b < num_bins - 1; b++) {
+      left.add(histogram[b]);
+      BinStats right = total;
+      right.count  -= left.count;
+      right.sum    -= left.sum;
+      right.sum_sq -= left.sum_sq;
+      if (left.count >= q && right.count >= q) {
+        double curr_error = left.error() + right.error();
+        if (curr_error < min_error) {
+          min_error   = curr_error;
+          min_feature = f;
+          min_bin     = b;
+          min_left    = left;
+          min_right   = right;
+        }
+      }
+    }  // for b
+  }  // for features
+
+  if (min_error + delta < node->error) {
+    node->feature_no  = min_feature;
+    /* Values below the upper boundary of min_bin fall into bins [0, min_bin]. */
+    ((RealNode*)node)->feature_val = quantizer.boundary(min_feature, min_bin);
+
+    int left_id  = ++max_id;
+    int right_id = ++max_id;
+    size_t middle = std::stable_partition(
+        rows.begin() + begin, rows.begin() + end,
+        [&](int row) { return data.bin(row, min_feature) <= min_bin; }) -
+        rows.begin();
+    for (size_t i = begin; i < end; i++) {
+      valid(rows[i]) = i < middle ? left_id : right_id;
+    }
+
+    node->left  = new RealNode(left_id);
+    node->left->output = min_left.sum / min_left.count;
+    node->left->error = min_left.error();
+    node->right = new RealNode(right_id);
+    node->right->output = min_right.sum / min_right.count;
+    node->right->error = min_right.error();
+
+    split_node_binned(node->left, data, outputs, rows, begin, middle,
+                      valid, max_id, delta, q);
+    split_node_binned(node->right, data, outputs, rows, middle, end,
+                      valid, max_id, delta, q);
+  }
+}
+
 void RegressionTree::set_output(Node* node, double output) {
   node->output = output;
 }
@@ -188,9 +323,47 @@ bool RegressionTree::set_output(Node* node, int node_id, double output)
   }
 }
 
-// TODO: IMPLEMENT!
-double RegressionTree::score(double* const& features) const {
-  return 0;
+double RegressionTree::score(feature_t* const& features) const {
+  if (tree == NULL) return 0;
+  const RealNode* node = tree;
+  while (node->left != NULL) {
+    node = static_cast<const RealNode*>(
+        features[node->feature_no] < node->feature_val ? node->left
+                                                       : node->right);
+  }
+  return node->output;
+}
+
+bool RegressionTree::save(const std::string& file_name) const {
+  TreeEnsemble ensemble;
+  ensemble.add_tree(*this, 1);
+  return ensemble.save(file_name);
+}
+
+void RegressionTree::flatten(std::vector<FlatTreeNode>& nodes) const {
+  size_t first = nodes.size();
+  if (tree == NULL) {
+    FlatTreeNode leaf = { 0, FlatTreeNode::LEAF, 0 };
+    nodes.push_back(leaf);
+    return;
+  }
+  std::vector<const Node*> queue(1, tree);
+  for (size_t i = 0; i < queue.size(); i++) {
+    const Node* node = queue[i];
+    FlatTreeNode flat;
+    if (node->left == NULL) {
+      flat.value   = node->output;
+      flat.feature = FlatTreeNode::LEAF;
+      flat.left    = 0;
+    } else {
+      flat.value   = static_cast<const RealNode*>(node)->feature_val;
+      flat.feature = static_cast<uint32_t>(node->feature_no);
+      flat.left    = static_cast<uint32_t>(first + queue.size());
+      queue.push_back(node->left);
+      queue.push_back(node->right);
+    }
+    nodes.push_back(flat);
+  }
 }
 
 std::string RegressionTree::str() const {
@@ -233,7 +406,8 @@ RegressionTree::Node::~Node() {
 
 RegressionTree::RealNode::RealNode(int id_) : Node(id_) {}
 
-RegressionTree::Comp::Comp(const ArrayXXd& data_, ArrayXXd::Index column_)
+RegressionTree::Comp::Comp(const DataContainer::DataMap& data_,
+                           ArrayXXd::Index column_)
   : data(data_), column(column_) {}
 
 bool RegressionTree::Comp::operator() (int i, int j) const {
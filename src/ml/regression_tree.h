@@ -25,12 +25,16 @@
 
 #include <string>
 #include <sstream>
+#include <vector>
 #include <stdexcept>
 #include <Eigen/Dense>
 
+#include <stdint.h>
+
 #include "ml/ml_model.h"
+#include "ml/data_container.h"
 
-class DataContainer;
+class BinnedFeatures;
 class LearningRate;
 
 using Eigen::ArrayXXd;
@@ -38,6 +42,22 @@ using Eigen::ArrayXd;
 using Eigen::ArrayXXi;
 using Eigen::ArrayXi;
 
+/**
+ * A node of a RegressionTree in the flat, pointer-free form used by
+ * TreeEnsemble and the model files. The children of a node are adjacent.
+ */
+struct FlatTreeNode {
+  /** The feature value we test against; the output in leaves. */
+  double value;
+  /** The index of the feature we test; @c LEAF in leaves. */
+  uint32_t feature;
+  /** The index of the left child; the right child is <tt>left + 1</tt>. */
+  uint32_t left;
+
+  /** The @c feature of leaves. */
+  static const uint32_t LEAF = 0xFFFFFFFF;
+};
+
 // TODO: Create in-memory model ancestor class
 class RegressionTree : public MlModel {
 protected:
@@ -81,10 +101,10 @@ protected:
 
   /** Comparator for build_tree. */
   struct Comp {
-    const ArrayXXd& data;
+    DataContainer::DataMap data;
     ArrayXXd::Index column;
 
-    Comp(const ArrayXXd& data, ArrayXXd::Index column=0);
+    Comp(const DataContainer::DataMap& data, ArrayXXd::Index column=0);
     /**
      * Checks if <tt>data[i][column] < data[j][column]</tt>. Basically we are
      * creating an index of @c data's @c column'th column.
@@ -113,9 +133,35 @@ public:
    */
   ArrayXi build_tree(const DataContainer& data, double delta, size_t q);
 
+  /**
+   * Builds the tree from binned data (see BinnedFeatures). Instead of sorting
+   * the rows by each feature, the split points are found from per-bin
+   * histograms of the outputs, so only the bin boundaries are considered as
+   * split points.
+   * @param[in] data the data we are learning from.
+   * @param[in] outputs the outputs (targets) of the rows in @p data.
+   * @param[in] delta if the error does not decrease by at least @p delta, stop.
+   * @param[in] q if one of the children would have at most q nodes, stop.
+   * @return the learning sample -> node id mapping as an array.
+   */
+  ArrayXi build_tree(const BinnedFeatures& data,
+                     const DataContainer::RelevanceMap& outputs,
+                     double delta, size_t q);
+
   // TODO: does this model need gradients at all? I don't think so.
 
-  double score(double* const& features) const;
+  double score(feature_t* const& features) const;
+
+  /**
+   * Saves the tree as a TreeEnsemble of a single tree; see ml/model_file.h.
+   */
+  bool save(const std::string& file_name) const;
+
+  /**
+   * Appends the nodes of the tree to @p nodes in breadth-first order; the
+   * root is the first node appended.
+   */
+  void flatten(std::vector<FlatTreeNode>& nodes) const;
 
   /** Prints the tree. */
   std::string str() const;
@@ -156,6 +202,20 @@ private:
                   ArrayXi& valid, int& max_id,
                   ArrayXi::Index num_docs, double delta, size_t q);
 
+  /**
+   * The binned version of split_node().
+   *
+   * @param[in,out] rows the rows under @p node are
+   *                     <tt>rows[begin, end)</tt>; partitioned between the
+   *                     children if the node is split.
+   * @param[in,out] valid the row -> node id mapping.
+   * @param[in,out] max_id the maximum node id thus far.
+   */
+  void split_node_binned(Node* node, const BinnedFeatures& data,
+                         const DataContainer::RelevanceMap& outputs,
+                         std::vector<int>& rows, size_t begin, size_t end,
+                         ArrayXi& valid, int& max_id, double delta, size_t q);
+
   /**
    * An index of data. The value of the <tt>n</tt>th cell in each column in
    * @c sorted is the row of the <tt>n</tt>th smallest number in the same column
@@ -0,0 +1,109 @@
+#include "ml/tree_ensemble.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "object.h"
+
+TreeEnsemble::TreeEnsemble()
+  : MlModel(0), nodes(NULL), roots(NULL), weights(NULL),
+    num_nodes(0), num_trees_(0) {}
+
+TreeEnsemble::TreeEnsemble(const std::shared_ptr<ModelFile>& file_)
+  : MlModel(file_->dimensions()), file(file_),
+    nodes(file_->block<FlatTreeNode>(0)),
+    roots(file_->block<uint32_t>(1)),
+    weights(file_->block<double>(2)),
+    num_nodes(file_->block_length<FlatTreeNode>(0)),
+    num_trees_(file_->block_length<uint32_t>(1)) {}
+
+TreeEnsemble* TreeEnsemble::create(const std::shared_ptr<ModelFile>& file) {
+  if (file->num_blocks() != 3 ||
+      file->block_length<double>(2) != file->block_length<uint32_t>(1)) {
+    return NULL;
+  }
+  TreeEnsemble* ensemble = new TreeEnsemble(file);
+  /* Check the node indices, so that score() cannot run off the array. */
+  bool valid = true;
+  for (size_t i = 0; i < ensemble->num_trees_; i++) {
+    valid = valid && ensemble->roots[i] < ensemble->num_nodes;
+  }
+  for (size_t i = 0; i < ensemble->num_nodes; i++) {
+    const FlatTreeNode& node = ensemble->nodes[i];
+    if (node.feature != FlatTreeNode::LEAF) {
+      valid = valid && node.feature < ensemble->dimensions &&
+              node.left > i && node.left + 1 < ensemble->num_nodes;
+    }
+  }
+  if (!valid) {
+    delete ensemble;
+    return NULL;
+  }
+  return ensemble;
+}
+
+TreeEnsemble* TreeEnsemble::clone() {
+  if (file) {
+    return new TreeEnsemble(file);
+  }
+  TreeEnsemble* ensemble = new TreeEnsemble();
+  ensemble->dimensions = dimensions;
+  ensemble->nodes_     = nodes_;
+  ensemble->roots_     = roots_;
+  ensemble->weights_   = weights_;
+  ensemble->refresh();
+  return ensemble;
+}
+
+void TreeEnsemble::refresh() {
+  nodes      = nodes_.data();
+  roots      = roots_.data();
+  weights    = weights_.data();
+  num_nodes  = nodes_.size();
+  num_trees_ = roots_.size();
+}
+
+void TreeEnsemble::add_tree(const RegressionTree& tree, double weight) {
+  if (file) {
+    throw UnsupportedOperationException();
+  }
+  size_t first = nodes_.size();
+  roots_.push_back(static_cast<uint32_t>(first));
+  weights_.push_back(weight);
+  tree.flatten(nodes_);
+  dimensions = std::max(dimensions, tree.get_dimensions());
+  for (size_t i = first; i < nodes_.size(); i++) {
+    if (nodes_[i].feature != FlatTreeNode::LEAF) {
+      dimensions = std::max<size_t>(dimensions, nodes_[i].feature + 1);
+    }
+  }
+  refresh();
+}
+
+double TreeEnsemble::score(feature_t* const& features) const {
+  double score = 0;
+  for (size_t t = 0; t < num_trees_; t++) {
+    const FlatTreeNode* node = nodes + roots[t];
+    while (node->feature != FlatTreeNode::LEAF) {
+      node = nodes + node->left +
+             (features[node->feature] < node->value ? 0 : 1);
+    }
+    score += weights[t] * node->value;
+  }
+  return score;
+}
+
+bool TreeEnsemble::save(const std::string& file_name) const {
+  ModelFileWriter writer(TREE_ENSEMBLE, dimensions, feature_layout);
+  writer.add_block(nodes, num_nodes * sizeof(FlatTreeNode));
+  writer.add_block(roots, num_trees_ * sizeof(uint32_t));
+  writer.add_block(weights, num_trees_ * sizeof(double));
+  return writer.save(file_name);
+}
+
+std::string TreeEnsemble::str() const {
+  std::ostringstream ss;
+  ss << "TreeEnsemble (dim: " << dimensions << ", trees: " << num_trees_
+     << ", nodes: " << num_nodes << ")";
+  return ss.str();
+}
@@ -0,0 +1,103 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * 
+ * A weighted sum of regression trees in flat form: the scoring-only model of
+ * MART and RegressionTree, which can be saved and mapped back by load_model().
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "ml/ml_model.h"
+#include "ml/model_file.h"
+#include "ml/regression_tree.h"
+
+/**
+ * An ensemble of regression trees. The nodes of all trees are stored in a
+ * single FlatTreeNode array, so scoring does not chase pointers through the
+ * heap. The arrays are either owned by the ensemble (when built with
+ * add_tree()), or point into a mapped model file (when loaded by
+ * load_model()); in the latter case, no trees can be added.
+ */
+class TreeEnsemble : public MlModel {
+public:
+  /** Creates an empty ensemble. */
+  TreeEnsemble();
+
+  /**
+   * Returns the ensemble in @p file, or @c NULL if the blocks are not
+   * consistent.
+   */
+  static TreeEnsemble* create(const std::shared_ptr<ModelFile>& file);
+
+  TreeEnsemble* clone();
+
+  /**
+   * Sets the number of features the ensemble expects, i.e. that of the
+   * training data; saved in the model file.
+   */
+  inline void set_dimensions(size_t dimensions) {
+    this->dimensions = dimensions;
+  }
+
+  /**
+   * Adds @p tree to the ensemble with weight @p weight. The dimensions of the
+   * ensemble are extended to those of @p tree, if it has more.
+   * @throw UnsupportedOperationException if the ensemble is mapped.
+   */
+  void add_tree(const RegressionTree& tree, double weight);
+
+  /** The weighted sum of the outputs of the trees. */
+  double score(feature_t* const& features) const;
+
+  /** Saves the ensemble; see ml/model_file.h. */
+  bool save(const std::string& file_name) const;
+
+  std::string str() const;
+
+  inline size_t num_trees() const { return num_trees_; }
+
+private:
+  TreeEnsemble(const std::shared_ptr<ModelFile>& file);
+
+  /** Points the arrays to the owned vectors. */
+  void refresh();
+
+  /** The model file, if the ensemble is mapped; shared by the clones. */
+  std::shared_ptr<ModelFile> file;
+  /** The owned arrays. */
+  std::vector<FlatTreeNode> nodes_;
+  std::vector<uint32_t> roots_;
+  std::vector<double> weights_;
+
+  /** The nodes of all trees. */
+  const FlatTreeNode* nodes;
+  /** The index of the root node of each tree. */
+  const uint32_t* roots;
+  /** The weight of each tree. */
+  const double* weights;
+  size_t num_nodes;
+  size_t num_trees_;
+};
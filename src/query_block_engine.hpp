@@ -0,0 +1,299 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * An execution engine specialized to the LTR graph. The graph is a star per
+ * query: the programs only do work in the query vertices, and each document
+ * has a single in-edge. Instead of the shards, the engine reads the query
+ * block store (see query_block_store.h), where the edges of a query are
+ * stored contiguously, so an iteration is a sequential scan of a single file.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "ltr_common.hpp"
+#include "dataset_manifest.h"
+#include "query_block_store.h"
+
+/**
+ * GraphChi program that writes the edges of each query vertex into a query
+ * block store. Must be run on a single thread; see build_query_block_store().
+ */
+class QueryBlockStoreBuilder : public GraphChiProgram<TypeVertex, FeatureEdge> {
+public:
+  QueryBlockStoreBuilder(QueryBlockStoreWriter& writer)
+    : writer(writer), ok_(true) {}
+
+  void update(graphchi_vertex<TypeVertex, FeatureEdge> &v,
+              graphchi_context &ginfo) {
+    /* Only queries have out-edges. */
+    if (v.num_outedges() == 0) return;
+
+    docs.resize(v.num_outedges());
+    features.clear();
+    for (int doc = 0; doc < v.num_outedges(); doc++) {
+      FeatureEdge* fe = v.outedge(doc)->get_vector();
+      docs[doc].relevance  = fe->header().relevance;
+      docs[doc].doc        = v.outedge(doc)->vertex_id();
+      docs[doc].ordinal    = fe->header().ordinal;
+      docs[doc].length     = static_cast<uint32_t>(fe->size());
+      docs[doc].sparse     = fe->header().sparse ? 1 : 0;
+      docs[doc].static_row = fe->header().static_row;
+      docs[doc].padding    = 0;
+      features.insert(features.end(), fe->get_data(),
+                      fe->get_data() + fe->size());
+    }
+    ok_ = writer.add_block(v.id(), docs, features) && ok_;
+  }
+
+  /** Whether all blocks could be written. */
+  inline bool ok() const { return ok_; }
+
+private:
+  QueryBlockStoreWriter& writer;
+  bool ok_;
+  std::vector<DocRecord> docs;
+  std::vector<feature_t> features;
+};
+
+/**
+ * Parses the value of the @c block_compression option: @c none, @c zlib or
+ * @c zstd. Any other value is fatal.
+ */
+inline Compression block_compression(const std::string& name) {
+  if (name == "none") return NO_COMPRESSION;
+  if (name == "zlib") return GZIP;
+  if (name == "zstd") return ZSTD;
+  logstream(LOG_FATAL) << "Unknown block compression: " << name << "; "
+                       << "select one of none, zlib, zstd." << std::endl;
+  return NO_COMPRESSION;
+}
+
+/**
+ * Creates store @p store_name with the compression set by the
+ * @c block_compression and @c block_compression_level options.
+ */
+inline bool open_query_block_writer(QueryBlockStoreWriter& writer,
+                                    const std::string& store_name,
+                                    uint64_t manifest_hash) {
+  return writer.open(store_name, manifest_hash,
+                     block_compression(
+                         get_option_string("block_compression", "none")),
+                     get_option_int("block_compression_level", 0));
+}
+
+/**
+ * Builds the query block store of @p file_name from its shards, unless the
+ * store already exists and was built from the same shards, i.e. the same
+ * dataset manifest, with the same compression. The compression is set by the
+ * @c block_compression and @c block_compression_level options.
+ *
+ * @param[in] nshards the number of shards; if @c QUERY_BLOCKS_ONLY, the store
+ *                    was written by read_inner(), and cannot be rebuilt.
+ * @return @c false if the store could not be written.
+ */
+inline bool build_query_block_store(const std::string& file_name,
+                                    int nshards) {
+  std::string store_name = QueryBlockStore::store_name(file_name);
+  uint64_t manifest_hash = hash_file(DatasetManifest::manifest_name(file_name));
+  Compression compression = block_compression(
+      get_option_string("block_compression", "none"));
+  QueryBlockStore store;
+  if (store.open(store_name) && store.manifest_hash() == manifest_hash &&
+      store.compression() == compression) {
+    logstream(LOG_INFO) << "Reusing the query block store of " << file_name
+                        << "." << std::endl;
+    return true;
+  }
+
+  if (nshards == QUERY_BLOCKS_ONLY) {
+    logstream(LOG_ERROR) << file_name << " has no shards to build the query "
+                         << "block store from." << std::endl;
+    return false;
+  }
+
+  logstream(LOG_INFO) << "Building the query block store of " << file_name
+                      << "." << std::endl;
+  QueryBlockStoreWriter writer;
+  if (!open_query_block_writer(writer, store_name, manifest_hash)) {
+    return false;
+  }
+  QueryBlockStoreBuilder builder(writer);
+  metrics m("ltr_qblocks");
+  graphchi_engine<TypeVertex, FeatureEdge> engine(file_name, nshards,
+                                                  false, m);
+  engine.set_exec_threads(1);
+  engine.set_disable_vertexdata_storage();
+  engine.set_modifies_inedges(false);
+  engine.set_modifies_outedges(false);
+  engine.run(builder, 1);
+  return writer.close(engine.num_vertices()) && builder.ok();
+}
+
+/**
+ * Runs a GraphChi program (an LtrAlgorithm) over the query block store of a
+ * dataset. The hooks are called with the same semantics as in
+ * @c graphchi_engine: before_iteration(), update() for each query vertex (in
+ * parallel, on @c execthreads threads), after_iteration(), and the run stops
+ * early if the program calls graphchi_context::set_last_iteration().
+ *
+ * update() is not called for the document vertices, as it does nothing for
+ * them in the LTR programs. The edges are presented as out-edges of the query
+ * vertex; they are read-only, as the scores are kept in an EdgeScores array.
+ *
+ * By default, the store is memory mapped, and an iteration is a single
+ * interval. If the @c prefetch option is set or the store is compressed, the
+ * store is read in chunks of at most half of @c membudget_mb by a
+ * QueryBlockPrefetcher, and each chunk is an interval: the next chunk is read
+ * and decompressed on a background thread while the exec threads run update()
+ * on the current one.
+ */
+class QueryBlockEngine {
+public:
+  /**
+   * Opens the query block store of @p file_name, and builds it from the
+   * @p nshards shards first, if needed. Failing to do either is fatal.
+   */
+  QueryBlockEngine(const std::string& file_name, int nshards)
+    : exec_threads(get_option_int("execthreads", omp_get_max_threads())) {
+    if (!build_query_block_store(file_name, nshards) ||
+        !store.open(QueryBlockStore::store_name(file_name))) {
+      logstream(LOG_FATAL) << "Cannot open the query block store of "
+                           << file_name << "." << std::endl;
+    }
+    if (get_option_int("prefetch", 0) ||
+        store.compression() != NO_COMPRESSION) {
+      size_t membudget = get_option_int("membudget_mb", 800);
+      prefetcher.reset(new QueryBlockPrefetcher(store,
+                                                membudget * 1024 * 1024 / 2));
+      logstream(LOG_INFO) << "Prefetching the query blocks in "
+                          << prefetcher->num_chunks() << " chunks."
+                          << std::endl;
+    }
+  }
+
+  void set_exec_threads(int exec_threads) {
+    this->exec_threads = exec_threads;
+  }
+
+  void run(GraphChiProgram<TypeVertex, FeatureEdge>& program, int niters) {
+    graphchi_context ginfo;
+    ginfo.nvertices      = store.num_vertices();
+    ginfo.num_iterations = niters;
+    ginfo.execthreads    = exec_threads;
+    ginfo.scheduler      = NULL;
+    vid_t last_vertex    = ginfo.nvertices > 0 ? ginfo.nvertices - 1 : 0;
+
+    for (int iter = 0; iter < niters; iter++) {
+      ginfo.iteration = iter;
+      program.before_iteration(iter, ginfo);
+
+      if (prefetcher.get() == NULL) {
+        program.before_exec_interval(0, last_vertex, ginfo);
+        run_blocks(program, ginfo, 0, store.num_queries(),
+                   [this](size_t i) { return store.block(i); });
+        program.after_exec_interval(0, last_vertex, ginfo);
+      } else {
+        if (!prefetcher->start()) {
+          logstream(LOG_FATAL) << "Cannot read the query block store "
+                               << store.name() << "." << std::endl;
+        }
+        size_t chunks = 0;
+        while (QueryBlockChunk* chunk = prefetcher->next()) {
+          /* The interval spans the query vertices in the chunk. */
+          vid_t from = chunk->block(store, chunk->first_block).query;
+          vid_t to   = chunk->block(store, chunk->last_block - 1).query;
+          program.before_exec_interval(from, to, ginfo);
+          run_blocks(program, ginfo, chunk->first_block, chunk->last_block,
+                     [this, chunk](size_t i) {
+                       return chunk->block(store, i);
+                     });
+          program.after_exec_interval(from, to, ginfo);
+          chunks++;
+        }
+        if (chunks != prefetcher->num_chunks()) {
+          logstream(LOG_FATAL) << "Cannot read the query block store "
+                               << store.name() << ": only " << chunks
+                               << " of its " << prefetcher->num_chunks()
+                               << " chunks could be read." << std::endl;
+        }
+      }
+
+      program.after_iteration(iter, ginfo);
+      if (ginfo.last_iteration >= 0 && iter >= ginfo.last_iteration) {
+        break;
+      }
+    }
+  }
+
+private:
+  /**
+   * Runs update() on the query vertices of blocks <tt>[first, last)</tt>, in
+   * parallel.
+   * @param[in] get_block returns the QueryBlockView of a block.
+   */
+  template <typename BlockGetter>
+  void run_blocks(GraphChiProgram<TypeVertex, FeatureEdge>& program,
+                  graphchi_context& ginfo, size_t first, size_t last,
+                  BlockGetter get_block) {
+#pragma omp parallel num_threads(exec_threads)
+    {
+      /* The edges of the current query, pointing into the block. */
+      std::vector<FeatureEdge> vectors;
+      std::vector<graphchi_edge<FeatureEdge> > edges;
+      TypeVertex query_data(QUERY);
+
+#pragma omp for schedule(dynamic, 64)
+      for (long i = static_cast<long>(first); i < static_cast<long>(last);
+           i++) {
+        QueryBlockView block = get_block(i);
+        vectors.resize(block.num_docs);
+        edges.resize(block.num_docs);
+        feature_t* features = block.features;
+        for (uint32_t d = 0; d < block.num_docs; d++) {
+          const DocRecord& doc = block.docs[d];
+          uint16_t length = static_cast<uint16_t>(doc.length);
+          vectors[d] = FeatureEdge(length, length,
+                                   EHeader(doc.relevance, doc.ordinal,
+                                           doc.sparse != 0, doc.static_row),
+                                   features);
+          edges[d] = graphchi_edge<FeatureEdge>(doc.doc, &vectors[d]);
+          features += doc.length;
+        }
+        graphchi_vertex<TypeVertex, FeatureEdge> vertex(
+            block.query, NULL, edges.data(), 0, block.num_docs);
+        vertex.set_data_ptr(&query_data);
+        program.update(vertex, ginfo);
+      }
+    }
+  }
+
+  /** The store. */
+  QueryBlockStore store;
+  /** The number of threads that run update(). */
+  int exec_threads;
+  /** Reads the store if the @c prefetch option is set. */
+  std::unique_ptr<QueryBlockPrefetcher> prefetcher;
+};
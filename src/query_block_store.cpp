@@ -0,0 +1,384 @@
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * The query block store.
+ */
+
+#include "query_block_store.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "logger/logger.hpp"
+
+const char QUERY_BLOCK_STORE_MAGIC[8] = { 'L', 'T', 'R', 'Q', 'B', 'L', 'K', 0 };
+
+namespace {
+/** Rounds @p pos up to the next multiple of 8. */
+inline uint64_t align8(uint64_t pos) {
+  return (pos + 7) & ~uint64_t(7);
+}
+}
+
+QueryBlockStoreWriter::QueryBlockStoreWriter()
+  : f(NULL), failed(false), level(0) {}
+
+QueryBlockStoreWriter::~QueryBlockStoreWriter() {
+  if (f != NULL) {
+    fclose(f);
+  }
+}
+
+bool QueryBlockStoreWriter::open(const std::string& file_name_,
+                                 uint64_t manifest_hash,
+                                 Compression compression, int level_) {
+#ifndef HAVE_ZSTD
+  if (compression == ZSTD) {
+    fprintf(stderr, "zstd support is not compiled in.\n");
+    return false;
+  }
+#endif
+  file_name = file_name_;
+  f = fopen(file_name.c_str(), "wb");
+  if (f == NULL) {
+    perror("Cannot create query block store");
+    return false;
+  }
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, QUERY_BLOCK_STORE_MAGIC, sizeof(header.magic));
+  header.version       = QUERY_BLOCK_STORE_VERSION;
+  header.feature_size  = sizeof(feature_t);
+  header.compression   = compression;
+  header.manifest_hash = manifest_hash;
+  level = level_;
+  failed = false;
+  index.assign(1, sizeof(header));
+  raw_index.assign(1, sizeof(header));
+  /* A placeholder; the real header is written by close(). */
+  return fwrite(&header, sizeof(header), 1, f) == 1;
+}
+
+bool QueryBlockStoreWriter::add_block(uint32_t query,
+                                      const std::vector<DocRecord>& docs,
+                                      const std::vector<feature_t>& features) {
+  QueryBlockHeader bh;
+  bh.query      = query;
+  bh.num_docs   = static_cast<uint32_t>(docs.size());
+  bh.num_values = features.size();
+  size_t docs_size     = docs.size() * sizeof(DocRecord);
+  size_t features_size = features.size() * sizeof(feature_t);
+  block.assign(align8(sizeof(bh) + docs_size + features_size), 0);
+  memcpy(block.data(), &bh, sizeof(bh));
+  memcpy(block.data() + sizeof(bh), docs.data(), docs_size);
+  memcpy(block.data() + sizeof(bh) + docs_size, features.data(),
+         features_size);
+
+  const char* data = block.data();
+  size_t size = block.size();
+  switch (header.compression) {
+    case GZIP:
+      {
+        uLongf packed_size = compressBound(size);
+        packed.resize(packed_size);
+        if (compress2(reinterpret_cast<Bytef*>(packed.data()), &packed_size,
+                      reinterpret_cast<const Bytef*>(data), size,
+                      level != 0 ? level : Z_DEFAULT_COMPRESSION) != Z_OK) {
+          logstream(LOG_FATAL) << "Cannot compress block " << index.size() - 1
+                               << " of " << file_name << "." << std::endl;
+          return false;
+        }
+        data = packed.data();
+        size = packed_size;
+      }
+      break;
+#ifdef HAVE_ZSTD
+    case ZSTD:
+      {
+        packed.resize(ZSTD_compressBound(size));
+        size_t packed_size = ZSTD_compress(packed.data(), packed.size(),
+                                           data, size, level);
+        if (ZSTD_isError(packed_size)) {
+          logstream(LOG_FATAL) << "Cannot compress block " << index.size() - 1
+                               << " of " << file_name << ": "
+                               << ZSTD_getErrorName(packed_size) << std::endl;
+          return false;
+        }
+        data = packed.data();
+        size = packed_size;
+      }
+      break;
+#endif
+    default:
+      break;
+  }
+
+  if (fwrite(data, 1, size, f) != size) {
+    perror("Cannot write query block store");
+    failed = !truncate_to_last_block();
+    return false;
+  }
+  index.push_back(index.back() + size);
+  raw_index.push_back(raw_index.back() + block.size());
+  header.num_queries++;
+  return true;
+}
+
+bool QueryBlockStoreWriter::truncate_to_last_block() {
+  clearerr(f);
+  return fflush(f) == 0 &&
+         ftruncate(fileno(f), static_cast<off_t>(index.back())) == 0 &&
+         fseek(f, static_cast<long>(index.back()), SEEK_SET) == 0;
+}
+
+bool QueryBlockStoreWriter::close(uint64_t num_vertices) {
+  header.num_vertices = num_vertices;
+  header.index_pos    = index.back();
+  header.file_size    = header.index_pos + 2 * index.size() * sizeof(uint64_t);
+  bool ok = !failed &&
+            fwrite(index.data(), sizeof(uint64_t), index.size(), f) ==
+                index.size() &&
+            fwrite(raw_index.data(), sizeof(uint64_t), raw_index.size(), f) ==
+                raw_index.size() &&
+            fseek(f, 0, SEEK_SET) == 0 &&
+            fwrite(&header, sizeof(header), 1, f) == 1;
+  ok = fclose(f) == 0 && ok;
+  f = NULL;
+  if (!ok) {
+    perror("Cannot write query block store");
+  }
+  return ok;
+}
+
+QueryBlockStore::QueryBlockStore() : index(NULL), raw_index(NULL) {
+  memset(&header, 0, sizeof(header));
+}
+
+bool QueryBlockStore::open(const std::string& file_name_) {
+  file_name = file_name_;
+  if (!file.open(file_name, true, true)) {
+    return false;
+  }
+  if (file.size() < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, file.begin(), sizeof(header));
+  if (memcmp(header.magic, QUERY_BLOCK_STORE_MAGIC, sizeof(header.magic)) ||
+      header.version != QUERY_BLOCK_STORE_VERSION ||
+      header.feature_size != sizeof(feature_t) ||
+      header.file_size != file.size() ||
+      header.index_pos + 2 * (header.num_queries + 1) * sizeof(uint64_t) !=
+          header.file_size) {
+    return false;
+  }
+  index     = reinterpret_cast<const uint64_t*>(file.begin() +
+                                                header.index_pos);
+  raw_index = index + header.num_queries + 1;
+  return true;
+}
+
+bool QueryBlockStore::decompress(size_t i, const char* src, char* dst) const {
+  size_t src_size = index[i + 1] - index[i];
+  size_t dst_size = raw_index[i + 1] - raw_index[i];
+  switch (header.compression) {
+    case NO_COMPRESSION:
+      memcpy(dst, src, dst_size);
+      return true;
+    case GZIP:
+      {
+        uLongf size = dst_size;
+        return uncompress(reinterpret_cast<Bytef*>(dst), &size,
+                          reinterpret_cast<const Bytef*>(src),
+                          src_size) == Z_OK && size == dst_size;
+      }
+#ifdef HAVE_ZSTD
+    case ZSTD:
+      return ZSTD_decompress(dst, dst_size, src, src_size) == dst_size;
+#endif
+    default:
+      return false;
+  }
+}
+
+QueryBlockView QueryBlockStore::view(char* p) {
+  const QueryBlockHeader* block = reinterpret_cast<const QueryBlockHeader*>(p);
+  QueryBlockView view;
+  view.query    = block->query;
+  view.num_docs = block->num_docs;
+  view.docs     = reinterpret_cast<const DocRecord*>(p + sizeof(*block));
+  view.features = reinterpret_cast<feature_t*>(
+      p + sizeof(*block) + view.num_docs * sizeof(DocRecord));
+  return view;
+}
+
+std::string QueryBlockStore::store_name(const std::string& file_name) {
+  return file_name + ".qblocks";
+}
+
+bool QueryBlockStore::set_manifest_hash(const std::string& file_name,
+                                        uint64_t manifest_hash) {
+  FILE* f = fopen(file_name.c_str(), "r+b");
+  if (f == NULL) {
+    perror("Cannot open query block store");
+    return false;
+  }
+  bool ok = fseek(f, offsetof(QueryBlockStoreHeader, manifest_hash),
+                  SEEK_SET) == 0 &&
+            fwrite(&manifest_hash, sizeof(manifest_hash), 1, f) == 1;
+  ok = fclose(f) == 0 && ok;
+  if (!ok) {
+    perror("Cannot write query block store");
+  }
+  return ok;
+}
+
+QueryBlockPrefetcher::QueryBlockPrefetcher(const QueryBlockStore& store_,
+                                           size_t chunk_size)
+  : store(store_), fd(-1), chunks_read(0), chunks_returned(0),
+    holding(false), stopped(false) {
+  full[0] = full[1] = false;
+  chunk_starts.push_back(0);
+  for (size_t i = 1; i < store.num_queries(); i++) {
+    if (store.raw_offset(i + 1) -
+        store.raw_offset(chunk_starts.back()) > chunk_size) {
+      chunk_starts.push_back(i);
+    }
+  }
+  chunk_starts.push_back(store.num_queries());
+  if (store.num_queries() == 0) {
+    chunk_starts.resize(1);
+  }
+}
+
+QueryBlockPrefetcher::~QueryBlockPrefetcher() {
+  stop();
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+void QueryBlockPrefetcher::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+  cond.notify_all();
+  if (reader.joinable()) {
+    reader.join();
+  }
+}
+
+bool QueryBlockPrefetcher::start() {
+  stop();
+  if (fd < 0 && (fd = open(store.name().c_str(), O_RDONLY)) < 0) {
+    perror("Cannot open query block store");
+    return false;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  full[0] = full[1] = false;
+  chunks_read = chunks_returned = 0;
+  holding = false;
+  stopped = false;
+  reader = std::thread(&QueryBlockPrefetcher::read_chunks, this);
+  return true;
+}
+
+void QueryBlockPrefetcher::read_chunks() {
+  for (size_t c = 0; c < num_chunks(); c++) {
+    QueryBlockChunk& chunk = buffers[c % 2];
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (!stopped && full[c % 2]) {
+        cond.wait(lock);
+      }
+      if (stopped) return;
+    }
+    /* The buffer is ours: read without holding the lock. */
+    chunk.first_block = chunk_starts[c];
+    chunk.last_block  = chunk_starts[c + 1];
+    chunk.base        = store.raw_offset(chunk.first_block);
+    chunk.data.resize(store.raw_offset(chunk.last_block) - chunk.base);
+    bool compressed = store.compression() != NO_COMPRESSION;
+    std::vector<char>& buffer = compressed ? chunk.packed : chunk.data;
+    uint64_t offset = store.block_offset(chunk.first_block);
+    size_t size = store.block_offset(chunk.last_block) - offset;
+    buffer.resize(size);
+    size_t done = 0;
+    while (done < size) {
+      ssize_t r = pread(fd, buffer.data() + done, size - done, offset + done);
+      if (r < 0 && errno == EINTR) continue;
+      if (r <= 0) {
+        perror("Cannot read query block store");
+        break;
+      }
+      done += r;
+    }
+    if (compressed && done == size) {
+      for (size_t i = chunk.first_block; i < chunk.last_block; i++) {
+        if (!store.decompress(i, buffer.data() +
+                                     (store.block_offset(i) - offset),
+                              chunk.data.data() +
+                                  (store.raw_offset(i) - chunk.base))) {
+          logstream(LOG_FATAL) << "Cannot decompress block " << i << " of "
+                               << store.name() << "." << std::endl;
+          done = 0;
+          break;
+        }
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (done < size) {
+        stopped = true;
+      } else {
+        full[c % 2] = true;
+        chunks_read++;
+      }
+    }
+    cond.notify_all();
+    if (done < size) return;
+  }
+}
+
+QueryBlockChunk* QueryBlockPrefetcher::next() {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (holding) {
+    full[(chunks_returned - 1) % 2] = false;
+    holding = false;
+    cond.notify_all();
+  }
+  while (!stopped && chunks_read == chunks_returned &&
+         chunks_returned < num_chunks()) {
+    cond.wait(lock);
+  }
+  if (chunks_read == chunks_returned) {
+    return NULL;
+  }
+  holding = true;
+  return &buffers[chunks_returned++ % 2];
+}
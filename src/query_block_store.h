@@ -0,0 +1,318 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * The query block store: the dataset stored as one contiguous block per
+ * query, so that an epoch is a single sequential scan of the file; see
+ * QueryBlockEngine. The file (<tt>\<dataset\>.qblocks</tt>) consists of
+ *
+ * 1. a QueryBlockStoreHeader;
+ * 2. the blocks, each aligned to 8 bytes: a QueryBlockHeader, followed by the
+ *    @c num_docs DocRecords of the documents, and the features of the
+ *    documents (@c feature_t values, concatenated);
+ * 3. the block index: <tt>num_queries + 1</tt> @c uint64_t offsets; block
+ *    @c i is <tt>[index[i], index[i + 1])</tt>;
+ * 4. the raw index: the offsets of the blocks in the uncompressed stream.
+ *
+ * If the store is compressed, each block is compressed separately, and the
+ * blocks in the file are not aligned; the raw index gives the (aligned)
+ * layout they are decompressed into. In an uncompressed store, the two
+ * indices are the same.
+ */
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+#include "tokenizer.h"  // MmapFile
+#include "compressed_input.h"  // Compression
+#include "ml/feature.h"
+
+/** The first bytes of a query block store file. */
+extern const char QUERY_BLOCK_STORE_MAGIC[8];
+/** The current version of the format. */
+const uint32_t QUERY_BLOCK_STORE_VERSION = 4;
+
+/** The header of a query block store file. */
+struct QueryBlockStoreHeader {
+  char     magic[8];
+  uint32_t version;
+  /** @c sizeof(feature_t). */
+  uint32_t feature_size;
+  /** How the blocks are compressed; a Compression (@c GZIP means zlib). */
+  uint32_t compression;
+  uint32_t padding;
+  /** The number of queries (blocks). */
+  uint64_t num_queries;
+  /** The number of vertices (queries and documents) in the graph. */
+  uint64_t num_vertices;
+  /** The hash of the dataset manifest the store was built from. */
+  uint64_t manifest_hash;
+  /** The position of the block index. */
+  uint64_t index_pos;
+  /** The size of the whole file. */
+  uint64_t file_size;
+};
+
+/** The header of a query block. */
+struct QueryBlockHeader {
+  /** The vertex id of the query. */
+  uint32_t query;
+  /** The number of documents. */
+  uint32_t num_docs;
+  /** The number of feature values in the block. */
+  uint64_t num_values;
+};
+
+/** A query-document edge in a block; see EHeader. */
+struct DocRecord {
+  int16_t  relevance;
+  /** Whether the features are (index, value) pairs. */
+  uint16_t sparse;
+  /** The vertex id of the document. */
+  uint32_t doc;
+  /** The edge ordinal; see EHeader. */
+  uint32_t ordinal;
+  /** The number of feature values of the document. */
+  uint32_t length;
+  /** The static feature row; see EHeader. */
+  uint32_t static_row;
+  /** Keeps the features that follow the records aligned. */
+  uint32_t padding;
+};
+
+/** Writes a query block store file sequentially. */
+class QueryBlockStoreWriter {
+public:
+  QueryBlockStoreWriter();
+  /** Calls close(). */
+  ~QueryBlockStoreWriter();
+
+  /**
+   * Creates file @p file_name.
+   * @param[in] compression how to compress the blocks: @c GZIP (zlib), or
+   *                        @c ZSTD, if compiled with @c HAVE_ZSTD.
+   * @param[in] level the compression level; 0 is the library default.
+   */
+  bool open(const std::string& file_name, uint64_t manifest_hash,
+            Compression compression=NO_COMPRESSION, int level=0);
+
+  /**
+   * Appends the block of query @p query. If the block cannot be written, the
+   * file is truncated to the end of the last block written, so the store can
+   * still be closed and read without it.
+   * @param[in] features the features of the documents, concatenated; the
+   *                     features of document @c i are @c docs[i].length long.
+   */
+  bool add_block(uint32_t query, const std::vector<DocRecord>& docs,
+                 const std::vector<feature_t>& features);
+
+  /**
+   * Writes the block index and the header, and closes the file.
+   * @param[in] num_vertices the number of vertices in the graph.
+   */
+  bool close(uint64_t num_vertices);
+
+private:
+  /* No copying. */
+  QueryBlockStoreWriter(const QueryBlockStoreWriter&);
+  QueryBlockStoreWriter& operator=(const QueryBlockStoreWriter&);
+
+  /** Drops the partially written block from the end of the file. */
+  bool truncate_to_last_block();
+
+  std::string file_name;
+  FILE* f;
+  /** Set if a partial block could not be dropped; close() fails then. */
+  bool failed;
+  QueryBlockStoreHeader header;
+  int level;
+  /** The block index and the raw index. */
+  std::vector<uint64_t> index;
+  std::vector<uint64_t> raw_index;
+  /** The current block, uncompressed and compressed. */
+  std::vector<char> block;
+  std::vector<char> packed;
+};
+
+/** A query block, as returned by QueryBlockStore::block(). */
+struct QueryBlockView {
+  uint32_t query;
+  uint32_t num_docs;
+  const DocRecord* docs;
+  /**
+   * The features of the documents, concatenated. They are in private memory
+   * (a copy-on-write mapping or a QueryBlockChunk), so FeatureEdges, which
+   * need a writable pointer, can point into them; writing them would not
+   * change the store.
+   */
+  feature_t* features;
+};
+
+/** Reads a query block store file mapped into memory. */
+class QueryBlockStore {
+public:
+  QueryBlockStore();
+
+  /**
+   * Maps file @p file_name into memory (with read-ahead and copy-on-write;
+   * see QueryBlockView), and checks it.
+   * @return @c false if the file cannot be mapped or is not a valid store
+   *                  written by a build with the same @c feature_t.
+   */
+  bool open(const std::string& file_name);
+
+  inline uint64_t num_queries() const { return header.num_queries; }
+  inline uint64_t num_vertices() const { return header.num_vertices; }
+  inline uint64_t manifest_hash() const { return header.manifest_hash; }
+
+  inline Compression compression() const {
+    return static_cast<Compression>(header.compression);
+  }
+
+  /** Returns block @p i. The store must not be compressed. */
+  inline QueryBlockView block(size_t i) const {
+    return view(file.writable_begin() + index[i]);
+  }
+
+  /** The position of block @p i in the file; @p i can be num_queries(). */
+  inline uint64_t block_offset(size_t i) const { return index[i]; }
+  /** The position of block @p i in the uncompressed stream. */
+  inline uint64_t raw_offset(size_t i) const { return raw_index[i]; }
+
+  /**
+   * Decompresses block @p i, read from the file into @p src, into @p dst,
+   * which must have room for <tt>raw_offset(i + 1) - raw_offset(i)</tt>
+   * bytes.
+   * @return @c false if the block is corrupt.
+   */
+  bool decompress(size_t i, const char* src, char* dst) const;
+  /** The name of the file. */
+  inline const std::string& name() const { return file_name; }
+
+  /** Returns the view of the block at @p p. */
+  static QueryBlockView view(char* p);
+
+  /** The name of the store file of dataset @p file_name. */
+  static std::string store_name(const std::string& file_name);
+
+  /**
+   * Overwrites the manifest hash in the header of store file @p file_name;
+   * for stores written before the manifest of their dataset.
+   */
+  static bool set_manifest_hash(const std::string& file_name,
+                                uint64_t manifest_hash);
+
+private:
+  std::string file_name;
+  MmapFile file;
+  QueryBlockStoreHeader header;
+  /** The block index and the raw index in @c file. */
+  const uint64_t* index;
+  const uint64_t* raw_index;
+};
+
+/**
+ * A run of consecutive blocks read into memory by QueryBlockPrefetcher. The
+ * unit of work of QueryBlockEngine, similar to an interval in GraphChi.
+ */
+struct QueryBlockChunk {
+  /** The blocks in the chunk: <tt>[first_block, last_block)</tt>. */
+  size_t first_block;
+  size_t last_block;
+  /** The raw offset of the first block; see QueryBlockStore::raw_offset(). */
+  uint64_t base;
+  /** The blocks, uncompressed. */
+  std::vector<char> data;
+  /** The compressed blocks, as read from the file. */
+  std::vector<char> packed;
+
+  /** Returns block @p i, which must be in the chunk. */
+  inline QueryBlockView block(const QueryBlockStore& store, size_t i) {
+    return QueryBlockStore::view(data.data() + (store.raw_offset(i) - base));
+  }
+};
+
+/**
+ * Reads the blocks of a QueryBlockStore in chunks on a background thread,
+ * into two buffers: while the caller processes a chunk, the next one is
+ * being read (and decompressed).
+ */
+class QueryBlockPrefetcher {
+public:
+  /**
+   * @param[in] chunk_size the (uncompressed) size of a chunk in bytes.
+   *                       Blocks larger than this get a chunk of their own.
+   */
+  QueryBlockPrefetcher(const QueryBlockStore& store, size_t chunk_size);
+  /** Stops the background thread. */
+  ~QueryBlockPrefetcher();
+
+  /** Starts reading the store from the beginning. */
+  bool start();
+
+  /**
+   * Releases the chunk returned by the previous call, and returns the next
+   * one, waiting for it if needed.
+   * @return the chunk, or @c NULL after the last one (or on error).
+   */
+  QueryBlockChunk* next();
+
+  /** The number of chunks in a pass. */
+  inline size_t num_chunks() const { return chunk_starts.size() - 1; }
+
+private:
+  /* No copying. */
+  QueryBlockPrefetcher(const QueryBlockPrefetcher&);
+  QueryBlockPrefetcher& operator=(const QueryBlockPrefetcher&);
+
+  /** The body of the background thread: reads all chunks of a pass. */
+  void read_chunks();
+  /** Stops and joins the background thread. */
+  void stop();
+
+  const QueryBlockStore& store;
+  /** The file descriptor of the store. */
+  int fd;
+  /** The first block of each chunk, plus the number of blocks. */
+  std::vector<size_t> chunk_starts;
+
+  /** The two buffers. */
+  QueryBlockChunk buffers[2];
+  /** Whether a buffer holds a chunk that has not been released yet. */
+  bool full[2];
+  /** The number of chunks read and returned in the current pass. */
+  size_t chunks_read;
+  size_t chunks_returned;
+  /** Whether the caller holds a chunk. */
+  bool holding;
+  /** Set by stop() (and on read errors) to end the pass. */
+  bool stopped;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::thread reader;
+};
@@ -0,0 +1,155 @@
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * Per-query metadata computed at ingestion.
+ */
+
+#include "query_table.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char QUERY_TABLE_MAGIC[8] = { 'L', 'T', 'R', 'Q', 'T', 'B', 0, 2 };
+
+}  // namespace
+
+void QueryTableBuilder::add(uint32_t query_index, int relevance) {
+  if (query_index >= docs.size()) {
+    docs.resize(query_index + 1);
+  }
+  docs[query_index].push_back(relevance);
+}
+
+bool QueryTableBuilder::save(const std::string& file_name,
+                             const std::vector<uint32_t>& query_vids) const {
+  int min_rel = 0;
+  int max_rel = 0;
+  bool first = true;
+  for (size_t q = 0; q < docs.size(); q++) {
+    for (size_t d = 0; d < docs[q].size(); d++) {
+      if (first || docs[q][d] < min_rel) min_rel = docs[q][d];
+      if (first || docs[q][d] > max_rel) max_rel = docs[q][d];
+      first = false;
+    }
+  }
+  uint64_t levels = static_cast<uint64_t>(max_rel - min_rel + 1);
+
+  std::vector<uint32_t> vids;
+  std::vector<uint64_t> offsets(1, 0);
+  std::vector<uint32_t> histograms;
+  for (size_t q = 0; q < docs.size(); q++) {
+    if (docs[q].empty()) continue;
+    vids.push_back(query_vids[q]);
+    offsets.push_back(offsets.back() + docs[q].size());
+    histograms.resize(histograms.size() + levels, 0);
+    uint32_t* histogram = &histograms[histograms.size() - levels];
+    for (size_t d = 0; d < docs[q].size(); d++) {
+      histogram[docs[q][d] - min_rel]++;
+    }
+  }
+
+  FILE* f = fopen(QueryTable::table_name(file_name).c_str(), "wb");
+  if (f == NULL) {
+    perror("Cannot save the query table");
+    return false;
+  }
+  uint64_t sizes[3] = { vids.size(), offsets.back(), levels };
+  int32_t min_level[2] = { min_rel, 0 };
+  bool ok = fwrite(QUERY_TABLE_MAGIC, sizeof(QUERY_TABLE_MAGIC), 1, f) == 1 &&
+            fwrite(sizes, sizeof(sizes), 1, f) == 1 &&
+            fwrite(min_level, sizeof(min_level), 1, f) == 1 &&
+            fwrite(vids.data(), sizeof(uint32_t), vids.size(), f) ==
+                vids.size() &&
+            fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), f) ==
+                offsets.size() &&
+            fwrite(histograms.data(), sizeof(uint32_t), histograms.size(),
+                   f) == histograms.size();
+  return fclose(f) == 0 && ok;
+}
+
+const size_t QueryTable::NOT_FOUND;
+
+QueryTable::QueryTable() : offsets(1, 0), min_rel(0), levels(0) {}
+
+bool QueryTable::load(const std::string& file_name) {
+  FILE* f = fopen(table_name(file_name).c_str(), "rb");
+  if (f == NULL) {
+    return false;
+  }
+  char magic[sizeof(QUERY_TABLE_MAGIC)];
+  uint64_t sizes[3];
+  int32_t min_level[2];
+  bool ok = fread(magic, sizeof(magic), 1, f) == 1 &&
+            memcmp(magic, QUERY_TABLE_MAGIC, sizeof(magic)) == 0 &&
+            fread(sizes, sizeof(sizes), 1, f) == 1 &&
+            fread(min_level, sizeof(min_level), 1, f) == 1;
+  if (ok) {
+    vids.resize(sizes[0]);
+    offsets.resize(sizes[0] + 1);
+    levels = sizes[2];
+    min_rel = min_level[0];
+    histograms.resize(sizes[0] * levels);
+    ok = fread(vids.data(), sizeof(uint32_t), vids.size(), f) ==
+             vids.size() &&
+         fread(offsets.data(), sizeof(uint64_t), offsets.size(), f) ==
+             offsets.size() &&
+         fread(histograms.data(), sizeof(uint32_t), histograms.size(), f) ==
+             histograms.size() &&
+         offsets.back() == sizes[1];
+  }
+  fclose(f);
+  return ok;
+}
+
+size_t QueryTable::find(uint32_t query) const {
+  std::vector<uint32_t>::const_iterator it =
+      std::lower_bound(vids.begin(), vids.end(), query);
+  if (it == vids.end() || *it != query) {
+    return NOT_FOUND;
+  }
+  return static_cast<size_t>(it - vids.begin());
+}
+
+double QueryTable::idcg(size_t i, size_t cutoff) const {
+  size_t docs = num_docs(i);
+  if (cutoff == 0 || cutoff > docs) {
+    cutoff = docs;
+  }
+  const uint32_t* counts = histogram(i);
+  double dcg = 0;
+  size_t rank = 0;
+  for (size_t l = levels; l-- > 0 && rank < cutoff;) {
+    double gain = pow(2, min_rel + static_cast<int>(l)) - 1;
+    for (uint32_t c = 0; c < counts[l] && rank < cutoff; c++, rank++) {
+      dcg += gain / (log(rank + 2) / log(2));
+    }
+  }
+  return dcg;
+}
+
+std::string QueryTable::table_name(const std::string& file_name) {
+  return file_name + ".qtable";
+}
@@ -0,0 +1,116 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Per-query metadata computed once at ingestion: the number of documents and
+ * the relevance histogram of each query, from which the ideal DCG is
+ * computed. The training and the evaluation read it instead of recomputing it
+ * in every iteration.
+ */
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+/**
+ * Collects the relevance of the documents of each query during ingestion, and
+ * saves the QueryTable of the dataset.
+ */
+class QueryTableBuilder {
+public:
+  /** Adds a document to query @p query_index (the interned query id). */
+  void add(uint32_t query_index, int relevance);
+
+  /**
+   * Saves the table of dataset @p file_name.
+   * @param[in] query_vids the vertex ids of the queries, by query index. They
+   *                       must be increasing; queries without documents
+   *                       (i.e. those dropped at ingestion) are skipped.
+   */
+  bool save(const std::string& file_name,
+            const std::vector<uint32_t>& query_vids) const;
+
+private:
+  /** The relevance of the documents, by query index. */
+  std::vector<std::vector<int> > docs;
+};
+
+/**
+ * The per-query metadata of a dataset, for each query vertex in vertex id
+ * order. A query is referred to by its index in the table; see find().
+ */
+class QueryTable {
+public:
+  /** Returned by find() for vertices that are not queries. */
+  static const size_t NOT_FOUND = static_cast<size_t>(-1);
+
+  QueryTable();
+
+  /** Loads the table of dataset @p file_name. */
+  bool load(const std::string& file_name);
+
+  /** The number of queries. */
+  inline size_t size() const { return vids.size(); }
+
+  /** Returns the index of query vertex @p query, or @c NOT_FOUND. */
+  size_t find(uint32_t query) const;
+
+  /** The vertex id of query @p i. */
+  inline uint32_t vid(size_t i) const { return vids[i]; }
+  /** The number of documents of query @p i. */
+  inline size_t num_docs(size_t i) const {
+    return static_cast<size_t>(offsets[i + 1] - offsets[i]);
+  }
+
+  /** The lowest relevance level in the dataset. */
+  inline int min_relevance() const { return min_rel; }
+  /** The number of relevance levels, from min_relevance() up. */
+  inline size_t num_levels() const { return levels; }
+  /**
+   * The relevance histogram of query @p i: the number of its documents with
+   * relevance <tt>min_relevance() + l</tt>, for each of the num_levels()
+   * levels @c l.
+   */
+  inline const uint32_t* histogram(size_t i) const {
+    return histograms.data() + i * levels;
+  }
+
+  /**
+   * Computes the ideal DCG of query @p i from its histogram, at @p cutoff
+   * documents; @c 0 means all documents.
+   */
+  double idcg(size_t i, size_t cutoff=0) const;
+
+  /** The name of the table file of dataset @p file_name. */
+  static std::string table_name(const std::string& file_name);
+
+private:
+  /** The vertex ids of the queries. */
+  std::vector<uint32_t> vids;
+  /** The documents of query @p i are <tt>[offsets[i], offsets[i + 1])</tt>. */
+  std::vector<uint64_t> offsets;
+  int min_rel;
+  size_t levels;
+  /** The histograms, concatenated. */
+  std::vector<uint32_t> histograms;
+};
@@ -89,8 +89,8 @@ public:
 //            cost(prob_ij(s_i, s_j), 0.5*(1 + S_ij)) << ", error: " << error << std::endl;
           //DYN umodel->update(*(query.outedge(i)->get_vector()), s_i, error);
           //DYN umodel->update(*(query.outedge(j)->get_vector()), s_j, -error);
-          umodel->update(query.outedge(i)->get_vector()->get_data(), s_i, error);
-          umodel->update(query.outedge(j)->get_vector()->get_data(), s_j, -error);
+          update_gradient(umodel, query.outedge(i), s_i, error);
+          update_gradient(umodel, query.outedge(j), s_j, -error);
           /* error(s_i) = -error(s_j) */
         }
       }
@@ -78,7 +78,7 @@ public:
 
     /* Finally, the model update. */
     for (int i = 0; i < query.num_outedges(); i++) {
-      umodel->update(query.outedge(i)->get_vector()->get_data(), s_is[i], lambdas[i]);
+      update_gradient(umodel, query.outedge(i), s_is[i], lambdas[i]);
     }
   }
 
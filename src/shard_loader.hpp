@@ -0,0 +1,135 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Loads the shards of a dataset into an in-memory DataContainer, so that the
+ * in-memory learners (e.g. MART) can use the shards built by read_inner()
+ * instead of parsing the text input again.
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "ltr_common.hpp"
+#include "query_block_engine.hpp"
+#include "static_features.h"
+#include "ml/data_container.h"
+
+/**
+ * GraphChi program that reads the query-document edges of each query vertex
+ * into an InputDataContainer, one query at a time. The query id of the rows
+ * is the vertex id of the query.
+ *
+ * The rows of a query are always contiguous in the container, but the order
+ * of the queries is only deterministic if the engine runs on a single thread;
+ * see load_shards().
+ */
+class ShardLoader : public GraphChiProgram<TypeVertex, FeatureEdge> {
+public:
+  /**
+   * @param[out] data the container the rows are added to.
+   * @param[in] static_features the static features of the dataset, if any;
+   *                            they are appended to the rows.
+   */
+  ShardLoader(InputDataContainer& data,
+              const StaticFeatureTable* static_features=NULL)
+    : data(data), static_features(static_features) {}
+
+  void update(graphchi_vertex<TypeVertex, FeatureEdge> &v,
+              graphchi_context &ginfo) {
+    /* Only queries have out-edges. */
+    if (v.num_outedges() == 0) return;
+
+    size_t dimensions = data.dimensions;
+    size_t rows = static_cast<size_t>(v.num_outedges());
+    features.assign(rows * dimensions, 0);
+    relevance.resize(rows);
+    for (size_t doc = 0; doc < rows; doc++) {
+      FeatureEdge* fe = v.outedge(doc)->get_vector();
+      double* row = &features[doc * dimensions];
+      const feature_t* values = fe->get_data();
+      size_t length = static_cast<size_t>(fe->size());
+      if (static_features != NULL) {
+        static_features->combine(values, length, fe->header().sparse,
+                                 fe->header().static_row, full_row);
+        values = full_row.data();
+        length = full_row.size();
+      }
+      if (fe->header().sparse) {
+        for (size_t i = 0; i + 1 < length; i += 2) {
+          size_t index = static_cast<size_t>(values[i]);
+          if (index < dimensions) row[index] = values[i + 1];
+        }
+      } else {
+        length = std::min(length, dimensions);
+        std::copy(values, values + length, row);
+      }
+      relevance[doc] = fe->header().relevance;
+    }
+    data.read_query_block(static_cast<int>(v.id()), features.data(), rows,
+                          dimensions, relevance.data());
+  }
+
+private:
+  /** The container we load the data into. */
+  InputDataContainer& data;
+  const StaticFeatureTable* static_features;
+  /** The features of the current edge, with the static ones. */
+  std::vector<feature_t> full_row;
+  /** Buffers for the rows of the current query. */
+  std::vector<double> features;
+  std::vector<int> relevance;
+};
+
+/**
+ * Loads the shards of @p file_name into @p data, and finalizes it. The
+ * engine runs on a single thread, as the container is not thread-safe, and
+ * so that the queries are loaded in vertex id order. If the @c engine option
+ * is @c blocks, the data is loaded from the query block store instead. The
+ * static features of the dataset, if any, are appended to the rows.
+ *
+ * @param[in] nshards the number of shards, as returned by read_cached().
+ * @param[out] data the container; its dimensions should be those returned by
+ *                  the reader.
+ */
+inline void load_shards(const std::string& file_name, int nshards,
+                        InputDataContainer& data) {
+  StaticFeatureTable static_features;
+  ShardLoader loader(data, static_features.load(file_name) ? &static_features
+                                                           : NULL);
+  if (get_option_string("engine", "graphchi") == "blocks") {
+    QueryBlockEngine engine(file_name, nshards);
+    engine.set_exec_threads(1);
+    engine.run(loader, 1);
+    data.finalize_data();
+    return;
+  }
+  metrics m("ltr_load");
+  graphchi_engine<TypeVertex, FeatureEdge> engine(file_name, nshards,
+                                                  false, m);
+  engine.set_exec_threads(1);
+  engine.set_disable_vertexdata_storage();
+  engine.set_modifies_inedges(false);
+  engine.set_modifies_outedges(false);
+  engine.run(loader, 1);
+  data.finalize_data();
+}
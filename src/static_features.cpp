@@ -0,0 +1,181 @@
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * Query-independent (document-static) features.
+ */
+
+#include "static_features.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const char STATIC_FEATURES_MAGIC[8] = { 'L', 'T', 'R', 'S', 'T', 'A', 0, 1 };
+
+}  // namespace
+
+std::vector<size_t> parse_feature_list(const std::string& list) {
+  std::vector<size_t> features;
+  size_t begin = 0;
+  while (begin < list.length()) {
+    size_t end = list.find(',', begin);
+    if (end == std::string::npos) end = list.length();
+    if (end > begin) {
+      features.push_back(strtoul(list.substr(begin, end - begin).c_str(),
+                                 NULL, 10));
+    }
+    begin = end + 1;
+  }
+  return features;
+}
+
+StaticColumns::StaticColumns(const std::vector<size_t>& columns_)
+  : columns(columns_) {
+  std::sort(columns.begin(), columns.end());
+  columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+  if (!columns.empty()) {
+    static_index.assign(columns.back() + 1, -1);
+    for (size_t i = 0; i < columns.size(); i++) {
+      static_index[columns[i]] = static_cast<int>(i);
+    }
+  }
+}
+
+void StaticColumns::split(std::vector<feature_t>& row, bool sparse,
+                          std::vector<feature_t>& static_row) const {
+  static_row.assign(columns.size(), 0);
+  size_t out = 0;
+  if (!sparse) {
+    for (size_t i = 0; i < row.size(); i++) {
+      if (i < static_index.size() && static_index[i] >= 0) {
+        static_row[static_index[i]] = row[i];
+      } else {
+        row[out++] = row[i];
+      }
+    }
+  } else {
+    for (size_t i = 0; i + 1 < row.size(); i += 2) {
+      size_t feature = static_cast<size_t>(row[i]);
+      if (feature < static_index.size() && static_index[feature] >= 0) {
+        static_row[static_index[feature]] = row[i + 1];
+      } else {
+        /* The number of static features before this one. */
+        size_t before = std::lower_bound(columns.begin(), columns.end(),
+                                         feature) - columns.begin();
+        row[out++] = static_cast<feature_t>(feature - before);
+        row[out++] = row[i + 1];
+      }
+    }
+  }
+  row.resize(out);
+}
+
+StaticFeatureTable::StaticFeatureTable() : num_columns(0), edge_dims(0) {}
+
+void StaticFeatureTable::reset(size_t width) {
+  num_columns = width;
+  edge_dims   = 0;
+  values.clear();
+  docs = IdInterner();
+  doc_rows.clear();
+}
+
+uint32_t StaticFeatureTable::add(const std::string& doc,
+                                 const std::vector<feature_t>& row) {
+  uint32_t index = static_cast<uint32_t>(rows());
+  if (!doc.empty()) {
+    uint32_t doc_index;
+    if (!docs.intern(doc, doc_index)) {
+      return doc_rows[doc_index];
+    }
+    doc_rows.push_back(index);
+  }
+  values.insert(values.end(), row.begin(), row.end());
+  return index;
+}
+
+void StaticFeatureTable::combine(const feature_t* features, size_t length,
+                                 bool sparse, uint32_t row,
+                                 std::vector<feature_t>& full) const {
+  const feature_t* static_row = this->row(row);
+  if (!sparse) {
+    full.assign(edge_dims + num_columns, 0);
+    std::copy(features, features + std::min(length, edge_dims), full.begin());
+    std::copy(static_row, static_row + num_columns, full.begin() + edge_dims);
+  } else {
+    full.assign(features, features + length);
+    for (size_t i = 0; i < num_columns; i++) {
+      if (static_row[i] != 0) {
+        full.push_back(static_cast<feature_t>(edge_dims + i));
+        full.push_back(static_row[i]);
+      }
+    }
+  }
+}
+
+std::string StaticFeatureTable::table_name(const std::string& file_name) {
+  return file_name + ".static";
+}
+
+bool StaticFeatureTable::save(const std::string& file_name) const {
+  FILE* f = fopen(table_name(file_name).c_str(), "wb");
+  if (f == NULL) {
+    perror("Cannot save the static features");
+    return false;
+  }
+  uint64_t sizes[3] = { num_columns, edge_dims, rows() };
+  uint32_t value_size = sizeof(feature_t);
+  bool ok = fwrite(STATIC_FEATURES_MAGIC, sizeof(STATIC_FEATURES_MAGIC), 1,
+                   f) == 1 &&
+            fwrite(&value_size, sizeof(value_size), 1, f) == 1 &&
+            fwrite(sizes, sizeof(sizes), 1, f) == 1 &&
+            fwrite(values.data(), sizeof(feature_t), values.size(), f) ==
+                values.size();
+  return fclose(f) == 0 && ok;
+}
+
+bool StaticFeatureTable::load(const std::string& file_name) {
+  FILE* f = fopen(table_name(file_name).c_str(), "rb");
+  if (f == NULL) {
+    return false;
+  }
+  char magic[sizeof(STATIC_FEATURES_MAGIC)];
+  uint32_t value_size = 0;
+  uint64_t sizes[3];
+  bool ok = fread(magic, sizeof(magic), 1, f) == 1 &&
+            memcmp(magic, STATIC_FEATURES_MAGIC, sizeof(magic)) == 0 &&
+            fread(&value_size, sizeof(value_size), 1, f) == 1 &&
+            value_size == sizeof(feature_t) &&
+            fread(sizes, sizeof(sizes), 1, f) == 1;
+  if (ok) {
+    num_columns = sizes[0];
+    edge_dims   = sizes[1];
+    values.resize(sizes[0] * sizes[2]);
+    ok = fread(values.data(), sizeof(feature_t), values.size(), f) ==
+             values.size();
+  }
+  fclose(f);
+  return ok;
+}
@@ -0,0 +1,134 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Query-independent (document-static) features, e.g. PageRank or URL length,
+ * stored once per document instead of on every query-document edge.
+ */
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "id_interner.h"
+#include "ml/feature.h"
+
+/**
+ * Parses a comma-separated list of feature indices, e.g. the value of the
+ * @c static_features option.
+ */
+std::vector<size_t> parse_feature_list(const std::string& list);
+
+/**
+ * Splits the rows read from the input into the edge features and the static
+ * features of the document. The static features are moved to the end of the
+ * feature vector seen by the models: a full row is the edge features, padded
+ * to edge_dimensions(), followed by the static features.
+ */
+class StaticColumns {
+public:
+  /** @param[in] columns the indices of the static features in the rows. */
+  StaticColumns(const std::vector<size_t>& columns=std::vector<size_t>());
+
+  /** Whether there are static features. */
+  inline bool empty() const { return columns.empty(); }
+  /** The number of static features. */
+  inline size_t size() const { return columns.size(); }
+
+  /**
+   * Removes the static features from @p row, and writes them into
+   * @p static_row. In sparse rows (@c index, @c value pairs), the remaining
+   * features are renumbered.
+   */
+  void split(std::vector<feature_t>& row, bool sparse,
+             std::vector<feature_t>& static_row) const;
+
+private:
+  /** The indices of the static features, sorted. */
+  std::vector<size_t> columns;
+  /** The index of each feature among the static ones, or -1. */
+  std::vector<int> static_index;
+};
+
+/**
+ * The static features of the documents of a dataset: one row per distinct
+ * document id. The edges refer to the rows via EHeader::static_row.
+ */
+class StaticFeatureTable {
+public:
+  StaticFeatureTable();
+
+  /**
+   * Creates an empty table.
+   * @param[in] width the number of static features.
+   */
+  void reset(size_t width);
+
+  /**
+   * Returns the row of document @p doc, adding @p values as a new row if the
+   * document has not been seen before, or if @p doc is empty (formats without
+   * document ids).
+   */
+  uint32_t add(const std::string& doc, const std::vector<feature_t>& values);
+
+  /** The number of static features. */
+  inline size_t width() const { return num_columns; }
+  /** The number of rows (documents). */
+  inline size_t rows() const { return num_columns > 0 ? values.size() /
+                                                        num_columns : 0; }
+  /** The static features of row @p row. */
+  inline const feature_t* row(uint32_t row) const {
+    return values.data() + static_cast<size_t>(row) * num_columns;
+  }
+
+  /** The number of the edge features; the static ones come after them. */
+  inline size_t edge_dimensions() const { return edge_dims; }
+  inline void set_edge_dimensions(size_t dims) { edge_dims = dims; }
+
+  /**
+   * Writes the full feature row of an edge into @p full: @p features, and the
+   * static features in row @p row after them.
+   * @param[in] length the number of values in @p features.
+   * @param[in] sparse whether @p features are (index, value) pairs; if so,
+   *                   so is @p full.
+   */
+  void combine(const feature_t* features, size_t length, bool sparse,
+               uint32_t row, std::vector<feature_t>& full) const;
+
+  /** Saves the table of dataset @p file_name. */
+  bool save(const std::string& file_name) const;
+  /** Loads the table of dataset @p file_name. */
+  bool load(const std::string& file_name);
+
+  /** The name of the table file of dataset @p file_name. */
+  static std::string table_name(const std::string& file_name);
+
+private:
+  size_t num_columns;
+  size_t edge_dims;
+  /** The rows, concatenated. */
+  std::vector<feature_t> values;
+  /** The ids of the documents with a row, and their rows. */
+  IdInterner docs;
+  std::vector<uint32_t> doc_rows;
+};
@@ -0,0 +1,295 @@
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * A zero-copy tokenizer for the text input formats.
+ */
+
+#include "tokenizer.h"
+
+#include <cstdio>    // perror
+#include <cstdlib>   // strtod
+#include <cstring>   // memcpy
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+MmapFile::MmapFile() : fd(-1), data(NULL), length(0), writable(false) {}
+
+MmapFile::~MmapFile() {
+  close();
+}
+
+bool MmapFile::open(const std::string& name, bool sequential,
+                    bool copy_on_write) {
+  close();
+  fd = ::open(name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    perror("open_file failed");
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    perror("open_file failed");
+    close();
+    return false;
+  }
+  length = static_cast<size_t>(st.st_size);
+  /* An empty file cannot be mapped; it is just an empty buffer. */
+  if (length == 0) {
+    return true;
+  }
+  int protection = copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ;
+  void* addr = mmap(NULL, length, protection, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED) {
+    perror("mmap failed");
+    close();
+    return false;
+  }
+  madvise(addr, length, sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+  data = static_cast<char*>(addr);
+  writable = copy_on_write;
+  return true;
+}
+
+void MmapFile::close() {
+  if (data != NULL) {
+    munmap(data, length);
+    data = NULL;
+  }
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+  length = 0;
+  writable = false;
+}
+
+const char* find_char(const char* begin, const char* end, char c) {
+  const char* p = begin;
+#ifdef __SSE2__
+  const __m128i needle = _mm_set1_epi8(c);
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; p < end; ++p) {
+    if (*p == c) return p;
+  }
+  return end;
+}
+
+const char* find_either(const char* begin, const char* end, char c1, char c2) {
+  const char* p = begin;
+#ifdef __SSE2__
+  const __m128i needle1 = _mm_set1_epi8(c1);
+  const __m128i needle2 = _mm_set1_epi8(c2);
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, needle1),
+                     _mm_cmpeq_epi8(chunk, needle2)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; p < end; ++p) {
+    if (*p == c1 || *p == c2) return p;
+  }
+  return end;
+}
+
+namespace {
+
+inline bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' ||
+         c == '\v' || c == '\f';
+}
+
+inline bool is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+/** The powers of 10 that are exactly representable as doubles. */
+const double exact_pow10[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * The slow path of parse_double(): copies the number to a NUL-terminated
+ * buffer (on the stack, if possible) and calls @c strtod.
+ */
+double parse_double_slow(const char* begin, const char* end) {
+  char buffer[128];
+  size_t len = static_cast<size_t>(end - begin);
+  if (len < sizeof(buffer)) {
+    memcpy(buffer, begin, len);
+    buffer[len] = '\0';
+    return strtod(buffer, NULL);
+  } else {
+    return strtod(std::string(begin, end).c_str(), NULL);
+  }
+}
+
+}  // namespace
+
+double parse_double(const char* p, const char* end) {
+  while (p < end && is_space(*p)) p++;
+  const char* start = p;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+
+  /* The significant digits, the decimal exponent and their validity. */
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool any_digits = false;
+  bool truncated = false;
+
+  for (; p < end && is_digit(*p); p++) {
+    any_digits = true;
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa != 0) digits++;
+    } else {
+      exponent++;
+      truncated = true;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && is_digit(*p); p++) {
+      any_digits = true;
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa != 0) digits++;
+        exponent--;
+      } else {
+        truncated = true;
+      }
+    }
+  }
+  if (!any_digits) {
+    /* inf, nan, hexadecimal, garbage: let the C library sort it out. */
+    return parse_double_slow(start, find_either(start, end, ',', ' '));
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char* e = p + 1;
+    bool exp_negative = false;
+    if (e < end && (*e == '-' || *e == '+')) {
+      exp_negative = *e == '-';
+      e++;
+    }
+    if (e < end && is_digit(*e)) {
+      int exp_value = 0;
+      for (; e < end && is_digit(*e); e++) {
+        if (exp_value < 10000) exp_value = exp_value * 10 + (*e - '0');
+      }
+      exponent += exp_negative ? -exp_value : exp_value;
+      p = e;
+    }
+  }
+
+  if (mantissa == 0) {
+    return negative ? -0.0 : 0.0;
+  }
+  /*
+   * Fast path: both the mantissa and the power of ten are exact doubles, so a
+   * single multiplication / division is correctly rounded.
+   */
+  if (!truncated && mantissa <= (1ULL << 53) &&
+      exponent >= -22 && exponent <= 22) {
+    double value = static_cast<double>(mantissa);
+    value = exponent >= 0 ? value * exact_pow10[exponent]
+                          : value / exact_pow10[-exponent];
+    return negative ? -value : value;
+  }
+  return parse_double_slow(start, p);
+}
+
+int parse_int(const char* p, const char* end) {
+  while (p < end && is_space(*p)) p++;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  int value = 0;
+  for (; p < end && is_digit(*p); p++) {
+    value = value * 10 + (*p - '0');
+  }
+  return negative ? -value : value;
+}
+
+LineTokenizer::LineTokenizer(const char* begin, const char* end)
+  : curr(begin), last(end) {}
+
+void LineTokenizer::reset(const char* begin, const char* end) {
+  curr = begin;
+  last = end;
+}
+
+bool LineTokenizer::next_line(const char*& line_begin, const char*& line_end) {
+  /* Empty lines are skipped. */
+  while (curr < last) {
+    const char* nl = find_char(curr, last, '\n');
+    line_begin = curr;
+    line_end = nl;
+    curr = nl < last ? nl + 1 : last;
+    if (line_end > line_begin && *(line_end - 1) == '\r') {
+      line_end--;
+    }
+    if (line_end > line_begin) {
+      return true;
+    }
+  }
+  return false;
+}
+
+FieldTokenizer::FieldTokenizer(const char* begin, const char* end,
+                               char delim1_, char delim2_)
+  : curr(begin), last(end), delim1(delim1_), delim2(delim2_) {}
+
+bool FieldTokenizer::next(const char*& field_begin, const char*& field_end) {
+  if (curr >= last) {
+    return false;
+  }
+  const char* p = find_either(curr, last, delim1, delim2);
+  field_begin = curr;
+  field_end = p;
+  curr = p < last ? p + 1 : last;
+  return true;
+}
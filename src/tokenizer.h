@@ -0,0 +1,142 @@
+#pragma once
+/**
+ * @file
+ * @author  David Nemeskey
+ * @version 1.0
+ *
+ * @section LICENSE
+ *
+ * Copyright [2013] [MTA SZTAKI]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * A zero-copy tokenizer for the text input formats. The input file is mapped
+ * into memory, and lines and fields are returned as <tt>[begin, end)</tt>
+ * pointer pairs into the mapping; numbers are parsed in place.
+ */
+
+#include <cstddef>
+#include <string>
+
+/** A read-only memory mapping of a whole file. */
+class MmapFile {
+public:
+  MmapFile();
+  ~MmapFile();
+
+  /**
+   * Maps file @p name into memory.
+   * @param[in] sequential whether the file is going to be read sequentially;
+   *                       if so, the kernel is advised to read ahead.
+   * @param[in] copy_on_write whether the mapping is writable. The pages are
+   *                          only copied when written, and the changes never
+   *                          reach the file.
+   * @return @c false if the file could not be opened or mapped.
+   */
+  bool open(const std::string& name, bool sequential=true,
+            bool copy_on_write=false);
+  /** Unmaps the file. Called by the destructor as well. */
+  void close();
+
+  inline const char* begin() const { return data; }
+  inline const char* end() const { return data + length; }
+  inline size_t size() const { return length; }
+  /** The start of a copy_on_write mapping; @c NULL for read-only ones. */
+  inline char* writable_begin() const { return writable ? data : NULL; }
+
+private:
+  /* No copying. */
+  MmapFile(const MmapFile&);
+  MmapFile& operator=(const MmapFile&);
+
+  /** The file descriptor. */
+  int fd;
+  /** The start of the mapping. */
+  char* data;
+  /** The size of the file. */
+  size_t length;
+  /** Whether the file was mapped copy_on_write. */
+  bool writable;
+};
+
+/**
+ * Returns a pointer to the first occurrence of @p c in <tt>[begin, end)</tt>,
+ * or @p end if there is none. Uses SSE2 if available.
+ */
+const char* find_char(const char* begin, const char* end, char c);
+
+/**
+ * Returns a pointer to the first occurrence of either @p c1 or @p c2 in
+ * <tt>[begin, end)</tt>, or @p end if there is none. Uses SSE2 if available.
+ */
+const char* find_either(const char* begin, const char* end, char c1, char c2);
+
+/**
+ * Parses a double from <tt>[begin, end)</tt> without allocating memory. The
+ * result is the same as that of @c atof: leading whitespace is skipped and
+ * parsing stops at the first character that cannot be part of the number.
+ */
+double parse_double(const char* begin, const char* end);
+
+/** Same as parse_double(), but for (decimal) integers; see @c atoi. */
+int parse_int(const char* begin, const char* end);
+
+/** Iterates through the lines in a memory buffer. */
+class LineTokenizer {
+public:
+  LineTokenizer(const char* begin=NULL, const char* end=NULL);
+
+  /** Restarts the iteration on <tt>[begin, end)</tt>. */
+  void reset(const char* begin, const char* end);
+
+  /**
+   * Returns the next line (without the line terminator) in
+   * <tt>[line_begin, line_end)</tt>.
+   * @return @c false at the end of the buffer.
+   */
+  bool next_line(const char*& line_begin, const char*& line_end);
+
+  /** The position of the next line. */
+  inline const char* position() const { return curr; }
+
+private:
+  /** The current position in the buffer. */
+  const char* curr;
+  /** The end of the buffer. */
+  const char* last;
+};
+
+/** Splits a line into fields. */
+class FieldTokenizer {
+public:
+  /**
+   * @param[in] delim1 the field separator.
+   * @param[in] delim2 an alternative separator (e.g. tab next to space).
+   */
+  FieldTokenizer(const char* begin, const char* end,
+                 char delim1, char delim2);
+
+  /**
+   * Returns the next field in <tt>[field_begin, field_end)</tt>. Fields may
+   * be empty, but as with @c std::getline, no empty field is returned after a
+   * trailing separator.
+   * @return @c false if there are no more fields.
+   */
+  bool next(const char*& field_begin, const char*& field_end);
+
+private:
+  const char* curr;
+  const char* last;
+  char delim1;
+  char delim2;
+};